@@ -0,0 +1,150 @@
+#ifndef BALANCE_HELPER_H
+#define BALANCE_HELPER_H
+
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <bit>
+#include <utility>
+#include <vector>
+#include <algorithm>
+
+namespace kg::detail {
+	// Default link access, for nodes with a 'Node* next[2]' member
+	struct node_links {
+		template <typename Node>
+		constexpr Node** operator()(Node* n) const {
+			return n->next;
+		}
+	};
+
+	// Rebalances the skip links of a list of nodes while walking it front to back.
+	// 'Links' gives access to the two links of a node, where 'next[0]' is the
+	// next node and 'next[1]' is the skip link.
+	//
+	// It lays the list out like 'balance_by_weight' does with equal weights: every
+	// node after the head is the root of a search tree over the nodes up to where
+	// its parent's subtree ends, and its skip link starts the second half of them.
+	// Skip links never cross, one either spans another or is clear of it, so the
+	// nodes that link to a node are all on the search path for its key. That is
+	// how erasing a node finds the links to move off it. Only the splits still
+	// waiting for their node are kept, which is about log2(n) of them.
+	template <typename Node, typename Links = node_links>
+	struct balance_helper {
+		// 'from' links to the node at 'first', which starts the nodes up to 'last'
+		struct split {
+			Node* from;
+			std::size_t first;
+			std::size_t last;
+		};
+
+		Node* head{};
+		Node* curr{};
+		std::size_t count{};
+		std::size_t index{ 0 };
+		std::size_t last{}; // where the subtree of 'curr' ends
+		std::vector<split> splits;
+
+		constexpr balance_helper(balance_helper const&) = default;
+		constexpr balance_helper(Node* const n, std::size_t count) : head(n), curr(n), count(count), last(count) {
+			splits.reserve(std::bit_width(count) + 1);
+		}
+		constexpr ~balance_helper() {
+			while (*this)
+				balance_current_and_advance();
+			links(head)[1] = curr;
+			links(curr)[1] = curr;
+		}
+		constexpr void balance_current_and_advance() {
+			assert(*this && "Called while invalid");
+
+			// Until its split is reached a node links to its neighbour, so the links
+			// do not cross part way through either. The head keeps its tail link.
+			Node* const next = links(curr)[0];
+			if (index > 0) {
+				links(curr)[1] = next;
+				std::size_t const middle = index + 1 + (last - index) / 2;
+				if (middle < last) {
+					splits.push_back({ curr, middle, last });
+					last = middle;
+				}
+			}
+
+			curr = next;
+			index += 1;
+			if (index == last) {
+				if (splits.empty()) { // more nodes than counted
+					last = index + 1;
+				}
+				else {
+					assert(splits.back().first == index);
+					links(splits.back().from)[1] = curr;
+					last = splits.back().last;
+					splits.pop_back();
+				}
+			}
+		}
+		constexpr operator bool() const {
+			return nullptr != links(curr)[0];
+		}
+
+	private:
+		constexpr static Node** links(Node* n) {
+			return Links{}(n);
+		}
+	};
+
+	// Lays out the skip links so that searches for heavier nodes take fewer steps.
+	// Every node after the head is the root of a binary search tree over the nodes up
+	// to where its parent's subtree ends: 'next[0]' starts the nodes before its skip
+	// link, and the skip link starts the ones after it. The skip link goes to the node
+	// that holds the middle of the weight, like the bisection rule for nearly optimal
+	// search trees, so the weight under a node halves at least every second step.
+	// With equal weights every search takes about log2(n) steps.
+	// 'weight(n)' is called once for each node, front to back.
+	template <typename Node, typename Links = node_links>
+	constexpr void balance_by_weight(Node* head, std::size_t count, auto&& weight) {
+		constexpr auto links = [](Node* n) { return Links{}(n); };
+		if (count == 0)
+			return;
+
+		std::vector<Node*> nodes;
+		std::vector<std::uint64_t> sums; // 'sums[i]' is the weight of the first 'i' nodes
+		nodes.reserve(count);
+		sums.reserve(count + 1);
+		sums.push_back(0);
+		for (Node* n = head; n; n = links(n)[0]) {
+			nodes.push_back(n);
+			sums.push_back(sums.back() + weight(n));
+		}
+		assert(nodes.size() == count && "Count does not match the list");
+
+		// The head links to the tail, and the rest of the list hangs off the second node
+		links(head)[1] = nodes.back();
+		struct span {
+			std::size_t first, last;
+		};
+		std::vector<span> pending;
+		if (count > 1)
+			pending.push_back({ 1, count });
+		while (!pending.empty()) {
+			auto const [first, last] = pending.back();
+			pending.pop_back();
+			if (last - first == 1) {
+				links(nodes[first])[1] = (last < count) ? nodes[last] : nodes[first];
+				continue;
+			}
+
+			// The last node that starts at or before the middle of the weight after 'first'
+			std::uint64_t const middle = sums[first + 1] + (sums[last] - sums[first + 1]) / 2;
+			auto const split = static_cast<std::size_t>(std::upper_bound(sums.begin() + first + 1, sums.begin() + last, middle) - sums.begin()) - 1;
+			links(nodes[first])[1] = nodes[split];
+			if (split > first + 1)
+				pending.push_back({ first + 1, split });
+			pending.push_back({ split, last });
+		}
+	}
+} // namespace kg::detail
+
+#endif // !BALANCE_HELPER_H
@@ -0,0 +1,224 @@
+#include <chrono>
+#include <numeric>
+#include <cstdio>
+#include <random>
+#include <ranges>
+#include <algorithm>
+#include <vector>
+#include "power_list.h"
+#include "power_kv_store.h"
+
+using namespace kg;
+
+// Returns the fastest of a few runs of 'fn', in milliseconds
+static double time_ms(auto&& fn, int runs = 5) {
+	double best = 1e300;
+	for (int run = 0; run < runs; run++) {
+		auto const start = std::chrono::steady_clock::now();
+		fn();
+		std::chrono::duration<double, std::milli> const elapsed = std::chrono::steady_clock::now() - start;
+		best = std::min(best, elapsed.count());
+	}
+	return best;
+}
+
+// Inserts the keys in random order, so the nodes that follow each other
+// in the list end up far apart in memory
+static power_list<long long> make_fragmented_list(int count) {
+	std::vector<long long> keys(count);
+	std::iota(keys.begin(), keys.end(), 0LL);
+	std::ranges::shuffle(keys, std::mt19937_64{ 42 });
+
+	power_list<long long> list;
+	for (std::size_t i = 0; i < keys.size(); i++) {
+		list.insert(keys[i]);
+		if (std::has_single_bit(i + 1))
+			list.rebalance();
+	}
+	list.rebalance();
+	return list;
+}
+
+// Starts out contiguous, then goes through rounds of erasing random elements
+// and inserting new ones next to random survivors, so the new nodes have to go
+// into the holes that the erased ones left
+using churned_list = power_list<long long, std::identity{}, power_list_options{ .deferred_erase = true }>;
+static churned_list make_churned_list(int count) {
+	std::mt19937_64 rng{ 42 };
+	std::vector<long long> keys(count);
+	for (std::size_t i = 0; i < keys.size(); i++)
+		keys[i] = 1024 * static_cast<long long>(i);
+
+	churned_list list(keys);
+	for (int round = 0; round < 4; round++) {
+		std::ranges::shuffle(keys, rng);
+		for (std::size_t i = 0; i < keys.size() / 10; i++)
+			list.remove(keys[i]);
+		list.purge();
+
+		for (std::size_t i = 0; i < keys.size() / 10; i++) {
+			keys[i] = keys[keys.size() - 1 - i] + 1 + static_cast<long long>(rng() % 1000);
+			list.insert(keys[i]);
+		}
+	}
+	list.rebalance();
+	return list;
+}
+
+static void bench_scans(char const* name, auto const& list) {
+	long long sum = 0;
+	double const plain = time_ms([&] {
+		for (auto it = list.cbegin(); it != list.cend(); ++it)
+			sum += *it;
+		});
+	double const ahead_8 = time_ms([&] {
+		for (long long v : list.template prefetched<8>())
+			sum += v;
+		});
+	double const ahead_16 = time_ms([&] {
+		for (long long v : list.template prefetched<16>())
+			sum += v;
+		});
+	std::printf("%-12s plain %8.2f ms   prefetched<8> %8.2f ms   prefetched<16> %8.2f ms   (%lld)\n", name, plain, ahead_8, ahead_16, sum);
+}
+
+// Throughput of the key-value store, in operations per second
+static void bench_kv_store(int count) {
+	auto const path = std::filesystem::temp_directory_path() / "power_kv_store_bench.dat";
+	std::filesystem::remove(path);
+
+	std::vector<std::string> keys(count);
+	for (int i = 0; i < count; i++)
+		keys[i] = "user" + std::to_string(1'000'000'000 + i);
+	std::ranges::shuffle(keys, std::mt19937_64{ 42 });
+	std::string const value(100, 'v');
+
+	double put_ms, get_ms, scan_ms, reopen_ms;
+	std::size_t found = 0;
+	{
+		power_kv_store store(path);
+		put_ms = time_ms([&] {
+			for (auto const& key : keys)
+				store.put(key, value);
+			store.flush();
+			}, 1);
+		get_ms = time_ms([&] {
+			for (auto const& key : keys)
+				found += store.get(key).has_value();
+			}, 1);
+		scan_ms = time_ms([&] {
+			store.scan("", "~", [&](std::string_view, std::string_view v) { found += v.size() == value.size(); });
+			}, 1);
+	}
+	reopen_ms = time_ms([&] { power_kv_store store(path); found += store.size(); }, 1);
+	std::filesystem::remove(path);
+
+	auto const per_second = [&](double ms) { return count / ms * 1000; };
+	std::printf("kv store     put %10.0f/s   get %10.0f/s   scan %10.0f/s   reopen %8.2f ms   (%zu)\n",
+		per_second(put_ms), per_second(get_ms), per_second(scan_ms), reopen_ms, found);
+}
+
+// Exact lookups of random keys, with and without the hash index, in nanoseconds per lookup
+static void bench_lookups(int count, int probes) {
+	using indexed_list = power_list<long long, std::identity{}, power_list_options{ .hash_index = true }>;
+	auto const keys = std::views::iota(0LL, static_cast<long long>(count));
+	power_list<long long> const plain(keys);
+	indexed_list const indexed(keys);
+
+	std::mt19937_64 rng{ 42 };
+	std::vector<long long> lookups(probes);
+	for (long long& key : lookups)
+		key = static_cast<long long>(rng() % (2 * static_cast<unsigned>(count))); // half of them miss
+
+	std::size_t found = 0;
+	double const search_ms = time_ms([&] {
+		for (long long key : lookups)
+			found += plain.contains(key);
+		}, 1);
+	double const index_ms = time_ms([&] {
+		for (long long key : lookups)
+			found += indexed.contains(key);
+		}, 1);
+	std::printf("lookups      search %8.1f ns   hash index %8.1f ns   (%zu)\n", search_ms * 1e6 / probes, index_ms * 1e6 / probes, found);
+}
+
+// Latency of lookups that follow a Zipf distribution, with the layout of 'rebalance'
+// and with the layout by access counts. Reports the median and 99th percentile of
+// all lookups, and the median of lookups for the 1% hottest and for the other keys.
+static void bench_skewed_lookups(int count, int probes) {
+	// Every lookup is counted, so the warm-up has enough of them for a new layout
+	using counted_list = power_list<long long, std::identity{}, power_list_options{ .access_counts = true, .access_sample_rate = 1 }>;
+	auto const keys = std::views::iota(0LL, static_cast<long long>(count));
+	power_list<long long> const balanced(keys);
+	counted_list counted(keys);
+
+	// Rank 'r' is drawn with a probability proportional to 1 / (r + 1), and the ranks
+	// are spread over the keys at random
+	std::vector<double> cdf(count);
+	double total = 0;
+	for (int r = 0; r < count; r++)
+		cdf[r] = total += 1.0 / (r + 1);
+	std::vector<long long> key_of_rank(count);
+	std::iota(key_of_rank.begin(), key_of_rank.end(), 0LL);
+	std::mt19937_64 rng{ 42 };
+	std::ranges::shuffle(key_of_rank, rng);
+	std::uniform_real_distribution<double> uniform(0, total);
+	auto const draw = [&] {
+		return static_cast<int>(std::ranges::lower_bound(cdf, uniform(rng)) - cdf.begin());
+	};
+
+	// Warm up the counts, and lay the list out by them
+	for (int i = 0; i < 4 * probes; i++)
+		(void)counted.contains(key_of_rank[draw()]);
+	counted.rebalance();
+
+	std::vector<int> ranks(probes);
+	for (int& rank : ranks)
+		rank = draw();
+
+	std::size_t found = 0;
+	auto const measure = [&](auto const& list) {
+		std::vector<double> hot, cold, all;
+		for (int rank : ranks) {
+			auto const start = std::chrono::steady_clock::now();
+			found += list.contains(key_of_rank[rank]);
+			std::chrono::duration<double, std::nano> const elapsed = std::chrono::steady_clock::now() - start;
+			(rank < count / 100 ? hot : cold).push_back(elapsed.count());
+			all.push_back(elapsed.count());
+		}
+		auto const percentile = [](std::vector<double>& v, double p) {
+			auto const nth = v.begin() + static_cast<std::ptrdiff_t>(p * static_cast<double>(v.size() - 1));
+			std::ranges::nth_element(v, nth);
+			return *nth;
+		};
+		std::printf("   p50 %7.0f ns   p99 %7.0f ns   hot p50 %7.0f ns   cold p50 %7.0f ns\n",
+			percentile(all, 0.5), percentile(all, 0.99), percentile(hot, 0.5), percentile(cold, 0.5));
+	};
+	std::printf("zipf lookups balanced ");
+	measure(balanced);
+	std::printf("             by access");
+	measure(counted);
+	std::printf("             (%zu)\n", found);
+}
+
+int main() {
+	constexpr int count = 4'000'000;
+
+	power_list<long long> const contiguous(std::views::iota(0LL, static_cast<long long>(count)));
+	bench_scans("contiguous", contiguous);
+
+	power_list<long long> fragmented = make_fragmented_list(count);
+	bench_scans("fragmented", fragmented);
+
+	double const relocate_time = time_ms([&] { fragmented.rebalance(relocate); }, 1);
+	bench_scans("relocated", fragmented);
+	std::printf("             relocating took %.2f ms\n", relocate_time);
+
+	// Erasing and inserting is much slower than scanning, so churn a smaller list
+	churned_list const churned = make_churned_list(count / 8);
+	bench_scans("churned", churned);
+
+	bench_kv_store(200'000);
+	bench_lookups(count / 4, 100'000);
+	bench_skewed_lookups(count / 4, 100'000);
+}
@@ -0,0 +1,128 @@
+#ifndef HASH_INDEX_H
+#define HASH_INDEX_H
+
+#include <algorithm>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <bit>
+#include <utility>
+#include <vector>
+
+namespace kg::detail {
+	// An open-addressing hash table of node pointers, with linear probing. It holds
+	// one node per key, and the hashes are given by the caller, so it knows nothing
+	// about keys. 'matches(n)' tells if node 'n' has the key being looked for.
+	// Erasing shifts the following entries back, so there are no tombstones, and
+	// probe runs stay short at up to half full.
+	template <typename Node>
+	class hash_index {
+	public:
+		// The node with the key, or nullptr
+		[[nodiscard]] constexpr Node* find(std::uint64_t hash, auto const& matches) const {
+			if (slots.empty())
+				return nullptr;
+			for (std::size_t i = home(hash); slots[i].node; i = (i + 1) & mask()) {
+				if (slots[i].hash == hash && matches(slots[i].node))
+					return slots[i].node;
+			}
+			return nullptr;
+		}
+
+		// Adds 'n' for its key, or replaces the node that has the key
+		constexpr void assign(std::uint64_t hash, Node* n, auto const& matches) {
+			slot& s = find_slot(hash, matches);
+			if (!s.node)
+				count += 1;
+			s = { n, hash };
+		}
+
+		// Adds 'n' for its key, unless there already is a node with the key
+		constexpr void emplace(std::uint64_t hash, Node* n, auto const& matches) {
+			slot& s = find_slot(hash, matches);
+			if (!s.node) {
+				s = { n, hash };
+				count += 1;
+			}
+		}
+
+		// Removes the entry of 'n', if there is one
+		constexpr void erase(std::uint64_t hash, Node const* n) {
+			if (slots.empty())
+				return;
+			std::size_t i = home(hash);
+			while (slots[i].node != n) {
+				if (!slots[i].node)
+					return;
+				i = (i + 1) & mask();
+			}
+
+			// Move back the entries after it that would not be found past the gap
+			for (std::size_t j = (i + 1) & mask(); slots[j].node; j = (j + 1) & mask()) {
+				if (((j - home(slots[j].hash)) & mask()) >= ((j - i) & mask())) {
+					slots[i] = slots[j];
+					i = j;
+				}
+			}
+			slots[i] = {};
+			count -= 1;
+		}
+
+		// Makes room for 'n' entries without growing
+		constexpr void reserve(std::size_t n) {
+			if (2 * n > slots.size())
+				rehash(std::bit_ceil(std::max<std::size_t>(min_slots, 2 * n)));
+		}
+
+		constexpr void clear() {
+			slots.clear();
+			count = 0;
+		}
+
+		[[nodiscard]] constexpr std::size_t size() const {
+			return count;
+		}
+
+	private:
+		static constexpr std::size_t min_slots = 16;
+
+		struct slot {
+			Node* node = nullptr;
+			std::uint64_t hash = 0;
+		};
+
+		constexpr std::size_t mask() const {
+			return slots.size() - 1;
+		}
+		constexpr std::size_t home(std::uint64_t hash) const {
+			return static_cast<std::size_t>(hash) & mask();
+		}
+
+		// The slot with the key, or the empty slot it would go in
+		constexpr slot& find_slot(std::uint64_t hash, auto const& matches) {
+			reserve(count + 1);
+			std::size_t i = home(hash);
+			while (slots[i].node && !(slots[i].hash == hash && matches(slots[i].node)))
+				i = (i + 1) & mask();
+			return slots[i];
+		}
+
+		constexpr void rehash(std::size_t size) {
+			assert(std::has_single_bit(size));
+			std::vector<slot> old = std::exchange(slots, std::vector<slot>(size));
+			for (slot const& s : old) {
+				if (!s.node)
+					continue;
+				std::size_t i = home(s.hash);
+				while (slots[i].node)
+					i = (i + 1) & mask();
+				slots[i] = s;
+			}
+		}
+
+		std::vector<slot> slots;
+		std::size_t count = 0;
+	};
+} // namespace kg::detail
+
+#endif // !HASH_INDEX_H
@@ -0,0 +1,346 @@
+#ifndef INTRUSIVE_POWER_LIST_H
+#define INTRUSIVE_POWER_LIST_H
+
+#include "balance_helper.h"
+#include <cassert>
+#include <cstdint>
+#include <functional>
+#include <iterator>
+#include <span>
+#include <utility>
+#include <algorithm>
+
+namespace kg {
+	// The two links of an intrusive_power_list, embedded in the element type
+	template <typename T>
+	struct power_list_hook {
+		T* next[2]{};
+	};
+
+	// Link access through a 'power_list_hook<T>' member
+	template <typename T, power_list_hook<T> T::* Hook>
+	struct hook_links {
+		constexpr T** operator()(T* n) const {
+			return (n->*Hook).next;
+		}
+	};
+
+	// A power_list over objects that are owned elsewhere. The objects carry the
+	// links themselves, and 'Links' returns the two links of an object, so linking
+	// and unlinking never allocates. The key of an object must not change while
+	// it is linked.
+	template <typename T, typename Links, auto Projection = std::identity{}>
+	class basic_intrusive_power_list {
+	public:
+		using key_type = std::remove_cvref_t<std::invoke_result_t<decltype(Projection) const&, T const&>>;
+
+	private:
+		using balance_helper = detail::balance_helper<T, Links>;
+
+	public:
+		struct iterator {
+			// iterator traits
+			using difference_type = ptrdiff_t;
+			using value_type = T;
+			using pointer = T*;
+			using reference = T&;
+			using iterator_category = std::forward_iterator_tag;
+
+			constexpr iterator() noexcept = default;
+			constexpr iterator(T* n) noexcept : curr(n) {}
+
+			constexpr iterator& operator++() {
+				assert(curr != nullptr && "Trying to step past end of list");
+				curr = next(curr)[0];
+				return *this;
+			}
+
+			constexpr iterator operator++(int) {
+				iterator const retval = *this;
+				++(*this);
+				return retval;
+			}
+
+			constexpr bool operator==(std::default_sentinel_t) const {
+				return curr == nullptr;
+			}
+
+			constexpr bool operator==(iterator const& other) const {
+				return curr == other.curr;
+			}
+
+			constexpr operator bool() const {
+				return curr != nullptr;
+			}
+
+			constexpr reference operator*() const {
+				assert(curr != nullptr && "Dereferencing null");
+				return *curr;
+			}
+
+			constexpr pointer operator->() const {
+				assert(curr != nullptr && "Dereferencing null");
+				return curr;
+			}
+
+		private:
+			T* curr{};
+		};
+		using const_iterator = iterator;
+
+		constexpr basic_intrusive_power_list() = default;
+		constexpr basic_intrusive_power_list(basic_intrusive_power_list const&) = delete;
+		constexpr basic_intrusive_power_list(basic_intrusive_power_list&& other) noexcept {
+			*this = std::move(other);
+		}
+		constexpr basic_intrusive_power_list& operator=(basic_intrusive_power_list const&) = delete;
+		// The objects linked in before are unlinked, so they can go into another list
+		constexpr basic_intrusive_power_list& operator=(basic_intrusive_power_list&& other) noexcept {
+			if (this == &other)
+				return *this;
+
+			clear();
+			head = std::exchange(other.head, nullptr);
+			count = other.count;
+			needs_rebalance = other.needs_rebalance;
+			other.count = 0;
+			other.needs_rebalance = false;
+			return *this;
+		}
+
+		constexpr bool operator==(basic_intrusive_power_list const& other) const {
+			if (count != other.count)
+				return false;
+
+			for (T* a = head, *b = other.head; a; a = next(a)[0], b = next(b)[0]) {
+				if (key(a) != key(b))
+					return false;
+			}
+			return true;
+		}
+
+		[[nodiscard]] constexpr iterator begin() const {
+			return { head };
+		}
+		[[nodiscard]] constexpr std::default_sentinel_t end() const {
+			return {};
+		}
+
+		[[nodiscard]] constexpr std::size_t size() const {
+			return count;
+		}
+
+		[[nodiscard]] constexpr bool empty() const {
+			return nullptr == head;
+		}
+
+		[[nodiscard]] constexpr T& front() const {
+			assert(!empty() && "Can not call 'front()' on an empty list");
+			return *head;
+		}
+
+		[[nodiscard]] constexpr T& back() const {
+			assert(!empty() && "Can not call 'back()' on an empty list");
+			return *next(head)[1];
+		}
+
+		// Unlinks all objects
+		constexpr void clear() {
+			for (T* n = head; n;) {
+				T* const following = next(n)[0];
+				next(n)[0] = next(n)[1] = nullptr;
+				n = following;
+			}
+			head = nullptr;
+			count = 0;
+			needs_rebalance = false;
+		}
+
+		// Links in an object. It must not already be in a list.
+		constexpr void insert(T& obj) {
+			T* const n = &obj;
+			assert(next(n)[0] == nullptr && next(n)[1] == nullptr && "Object is already linked");
+			key_type const& k = key(n);
+
+			if (head == nullptr) { // empty
+				next(n)[1] = n;
+				head = n;
+			}
+			else if (!(key(head) < k)) { // before head
+				next(n)[0] = head;
+				next(n)[1] = next(head)[1];
+				head = n;
+			}
+			else if (T* last = next(head)[1]; key(last) < k) { // after tail
+				next(last)[0] = n;
+				next(last)[1] = n;
+				next(head)[1] = n;
+				next(n)[1] = n;
+			}
+			else { // middle
+				auto const [prev, curr] = locate(k);
+				next(prev)[0] = n;
+				next(n)[0] = curr;
+				next(n)[1] = curr; // a copy of the skip link of 'curr' could cross the links to 'curr'
+			}
+
+			count += 1;
+			needs_rebalance = true;
+		}
+
+		// Unlinks an object that is in this list
+		constexpr void erase(T& obj) {
+			T* const n = &obj;
+
+			T* const following = next(n)[0];
+
+			// Skip links do not cross, so the nodes linking to 'n' are on the search
+			// path for its key, and the node in front of it ends that path
+			T* prev = nullptr;
+			for_path_to(n, [&](T* p) {
+				if (following && next(p)[1] == n)
+					next(p)[1] = following;
+				prev = p;
+			});
+			if (!following) {
+				for_path_to(n, [&](T* p) {
+					if (next(p)[1] == n)
+						next(p)[1] = prev;
+				});
+			}
+
+			if (prev == nullptr) { // head
+				if (following != nullptr)
+					next(following)[1] = next(n)[1];
+				head = following;
+			}
+			else {
+				if (following == nullptr) { // tail
+					next(head)[1] = prev;
+					next(prev)[1] = prev;
+				}
+				next(prev)[0] = following;
+			}
+
+			next(n)[0] = next(n)[1] = nullptr;
+			count -= 1;
+			needs_rebalance = true;
+		}
+
+		constexpr void rebalance() {
+			if (head && needs_rebalance) {
+				balance_helper bh(head, count);
+				while (bh)
+					bh.balance_current_and_advance();
+
+				needs_rebalance = false;
+			}
+		}
+
+		// Returns the first object with the key, or null
+		[[nodiscard]] constexpr T* find(key_type const& val) const {
+			if (head == nullptr || val < key(head) || val > key(next(head)[1]))
+				return nullptr;
+
+			T* const n = descend(head, val);
+			return (key(n) == val) ? n : nullptr;
+		}
+
+		[[nodiscard]] constexpr iterator lower_bound(key_type const& val) const {
+			return { locate(val).second };
+		}
+
+		[[nodiscard]] constexpr bool contains(key_type const& val) const {
+			return nullptr != find(val);
+		}
+
+		// Sets bit 'i' in 'mask_out' if 'probes[i]' is in the list. The probes must be sorted.
+		constexpr void contains_batch(std::span<key_type const> probes, std::span<std::uint64_t> mask_out) const {
+			assert(mask_out.size() * 64 >= probes.size() && "Mask is too small for the probes");
+			assert(std::ranges::is_sorted(probes) && "Probes must be sorted");
+			std::ranges::fill(mask_out, std::uint64_t{ 0 });
+			if (empty())
+				return;
+
+			key_type const& tail = key(next(head)[1]);
+			T* finger = head;
+			std::size_t i = 0;
+			while (i < probes.size() && probes[i] < key(head))
+				i += 1;
+			while (i < probes.size() && !(probes[i] > tail)) {
+				finger = descend(finger, probes[i]);
+				do {
+					mask_out[i / 64] |= std::uint64_t{ key(finger) == probes[i] } << (i % 64);
+					i += 1;
+				} while (i < probes.size() && !(key(finger) < probes[i]));
+			}
+		}
+
+	private:
+		constexpr static T** next(T* n) {
+			return Links{}(n);
+		}
+
+		constexpr static decltype(auto) key(T const* n) {
+			return std::invoke(Projection, *n);
+		}
+
+		// Finger search. Returns the first node from 'n' that is not less than 'val'.
+		// 'n' must not be past 'val', and 'val' must not be past the tail.
+		constexpr static T* descend(T* n, key_type const& val) {
+			while (next(n)[0] && val > key(next(n)[0]))
+				n = next(n)[val > key(next(n)[1])];
+			while (key(n) < val)
+				n = next(n)[0];
+			return n;
+		}
+
+		// Calls 'fn' with each node on the search path for the key of 'n', and then with
+		// the nodes of equal keys before it, so the last one is the node before 'n'
+		constexpr void for_path_to(T* n, auto&& fn) const {
+			auto const& k = key(n);
+			assert(!(key(next(head)[1]) < k) && "Object is not in this list");
+			T* curr = head;
+			while (key(curr) < k) {
+				T* const following = next(curr)[key(next(curr)[1]) < k];
+				fn(curr); // may move the links off 'n'
+				curr = following;
+			}
+			for (; curr != n; curr = next(curr)[0]) {
+				assert(curr != nullptr && "Object is not in this list");
+				fn(curr);
+			}
+		}
+
+		// Returns the node before the first node not less than 'val', and that node.
+		// Either can be null.
+		constexpr std::pair<T*, T*> locate(key_type const& val) const {
+			if (empty() || !(key(head) < val))
+				return { nullptr, head };
+
+			T* const tail = next(head)[1];
+			if (key(tail) < val)
+				return { tail, nullptr };
+
+			T* prev = nullptr;
+			T* curr = head;
+			while (key(curr) < val) {
+				prev = curr;
+				curr = next(curr)[key(next(curr)[1]) < val];
+			}
+			return { prev, curr };
+		}
+
+		T* head = nullptr;
+		std::size_t count : 63 = 0;
+		std::size_t needs_rebalance : 1 = false;
+	};
+
+	// An intrusive power_list where the links are in a 'power_list_hook<T>' member.
+	//
+	//   struct item { int id; power_list_hook<item> hook; };
+	//   intrusive_power_list<item, &item::hook, &item::id> list;
+	template <typename T, power_list_hook<T> T::* Hook, auto Projection = std::identity{}>
+	using intrusive_power_list = basic_intrusive_power_list<T, hook_links<T, Hook>, Projection>;
+}
+#endif
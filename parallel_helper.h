@@ -0,0 +1,41 @@
+#ifndef PARALLEL_HELPER_H
+#define PARALLEL_HELPER_H
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <thread>
+#include <vector>
+
+namespace kg {
+	// Selects the parallel overload of an algorithm, eg. 'set_union(kg::par, a, b)'
+	struct parallel_t {
+		explicit parallel_t() = default;
+	};
+	inline constexpr parallel_t par{};
+}
+
+namespace kg::detail {
+	// The number of threads to spread work over
+	inline std::size_t worker_count() {
+		return std::max(1u, std::thread::hardware_concurrency());
+	}
+
+	// Runs 'fn(i)' for every i in [0, tasks) on up to 'worker_count()' threads, the
+	// calling thread included. Tasks are claimed one at a time from a shared counter,
+	// so threads that finish early keep taking work from the ones that are behind.
+	inline void parallel_for(std::size_t tasks, auto&& fn) {
+		std::atomic<std::size_t> next_task = 0;
+		auto const worker = [&] {
+			for (std::size_t i = next_task++; i < tasks; i = next_task++)
+				fn(i);
+		};
+
+		std::vector<std::jthread> threads;
+		for (std::size_t i = 1; i < std::min(tasks, worker_count()); i++)
+			threads.emplace_back(worker);
+		worker();
+	}
+}
+
+#endif // !PARALLEL_HELPER_H
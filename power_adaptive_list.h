@@ -0,0 +1,227 @@
+#ifndef POWER_ADAPTIVE_LIST_H
+#define POWER_ADAPTIVE_LIST_H
+
+#include "power_list.h"
+#include <cassert>
+#include <algorithm>
+#include <functional>
+#include <iterator>
+#include <vector>
+
+namespace kg {
+	// A sorted container that changes its representation with the workload.
+	// While reads dominate the elements are kept in a contiguous sorted array,
+	// which is searched with a binary search. When more than 'WritePercent' of
+	// the operations in a window of 'Window' operations are writes, the elements
+	// are moved into a power_list, and when writes drop below a quarter of that,
+	// they are moved back into an array.
+	template <typename T, auto Projection = std::identity{}, std::size_t WritePercent = 10, std::size_t Window = 1024>
+	class power_adaptive_list {
+		static_assert(WritePercent > 0 && WritePercent < 100);
+		static_assert(Window > 0);
+
+		using list_type = power_list<T, Projection>;
+
+	public:
+		using key_type = typename list_type::key_type;
+
+		struct iterator {
+			friend class power_adaptive_list;
+
+			// iterator traits
+			using difference_type = ptrdiff_t;
+			using value_type = T;
+			using pointer = const T*;
+			using reference = const T&;
+			using iterator_category = std::forward_iterator_tag;
+
+			constexpr iterator() noexcept = default;
+
+			constexpr iterator& operator++() {
+				if (array_curr)
+					array_curr += 1;
+				else
+					++list_curr;
+				return *this;
+			}
+
+			constexpr iterator operator++(int) {
+				iterator retval = *this;
+				++(*this);
+				return retval;
+			}
+
+			constexpr bool operator==(std::default_sentinel_t) const {
+				return array_curr ? (array_curr == array_end) : (list_curr == std::default_sentinel);
+			}
+
+			constexpr reference operator*() const {
+				return array_curr ? *array_curr : *list_curr.operator->();
+			}
+
+			constexpr pointer operator->() const {
+				return array_curr ? array_curr : list_curr.operator->();
+			}
+
+		private:
+			T const* array_curr{};
+			T const* array_end{};
+			typename list_type::iterator list_curr;
+		};
+
+		constexpr power_adaptive_list() = default;
+
+		constexpr power_adaptive_list(std::ranges::sized_range auto const& range) {
+			assert(std::ranges::is_sorted(range, {}, Projection) && "Input range must be sorted");
+			array.assign(std::ranges::begin(range), std::ranges::end(range));
+		}
+
+		[[nodiscard]] constexpr iterator begin() const {
+			iterator it;
+			if (linked) {
+				it.list_curr = list.cbegin();
+			}
+			else if (!array.empty()) {
+				it.array_curr = array.data();
+				it.array_end = array.data() + array.size();
+			}
+			return it;
+		}
+		[[nodiscard]] constexpr std::default_sentinel_t end() const {
+			return {};
+		}
+
+		[[nodiscard]] constexpr std::size_t size() const {
+			return linked ? list.size() : array.size();
+		}
+
+		[[nodiscard]] constexpr bool empty() const {
+			return size() == 0;
+		}
+
+		// True while the elements are in the linked representation
+		[[nodiscard]] constexpr bool is_linked() const {
+			return linked;
+		}
+
+		constexpr void insert(T val) {
+			if (linked) {
+				list.insert(std::move(val));
+				count_linked_write();
+			}
+			else {
+				auto const it = std::ranges::upper_bound(array, std::invoke(Projection, val), {}, Projection);
+				array.insert(it, std::move(val));
+			}
+			count_write();
+		}
+
+		constexpr void remove(key_type const& key) {
+			if (linked) {
+				list.remove(key);
+				count_linked_write();
+			}
+			else {
+				auto const it = std::ranges::lower_bound(array, key, {}, Projection);
+				if (it != array.end() && std::invoke(Projection, *it) == key)
+					array.erase(it);
+			}
+			count_write();
+		}
+
+		// Returns the first element with the key, or null
+		[[nodiscard]] constexpr T const* find(key_type const& key) {
+			T const* result = nullptr;
+			if (linked) {
+				auto const it = list.find(key);
+				result = it ? it.operator->() : nullptr;
+			}
+			else {
+				auto const it = std::ranges::lower_bound(array, key, {}, Projection);
+				if (it != array.end() && std::invoke(Projection, *it) == key)
+					result = &*it;
+			}
+			count_read();
+			return result;
+		}
+
+		// Returns the first element not less than the key, or null
+		[[nodiscard]] constexpr T const* lower_bound(key_type const& key) {
+			T const* result = nullptr;
+			if (linked) {
+				auto const it = list.lower_bound(key);
+				result = it ? it.operator->() : nullptr;
+			}
+			else {
+				auto const it = std::ranges::lower_bound(array, key, {}, Projection);
+				result = (it != array.end()) ? &*it : nullptr;
+			}
+			count_read();
+			return result;
+		}
+
+		[[nodiscard]] constexpr bool contains(key_type const& key) {
+			return nullptr != find(key);
+		}
+
+		// Rebalances the linked representation. The array needs none.
+		constexpr void rebalance() {
+			if (linked)
+				list.rebalance();
+			writes_since_rebalance = 0;
+		}
+
+	private:
+		constexpr void count_read() {
+			reads += 1;
+			if (reads + writes >= Window)
+				adapt();
+		}
+
+		constexpr void count_write() {
+			writes += 1;
+			if (reads + writes >= Window)
+				adapt();
+		}
+
+		// Inserts and removes only fix the links next to them. Rebalancing is O(n), so doing
+		// it after a fixed fraction of the list is new keeps writes O(1) amortized.
+		constexpr void count_linked_write() {
+			writes_since_rebalance += 1;
+			if (writes_since_rebalance > list.size() / 32 + 64)
+				rebalance();
+		}
+
+		// Picks the representation for the write rate of the window that just ended
+		constexpr void adapt() {
+			// Compared in whole counts, so small percents do not round down to zero
+			std::size_t const ops = reads + writes;
+			std::size_t const write_ops = writes;
+			reads = 0;
+			writes = 0;
+
+			if (!linked && 100 * write_ops > WritePercent * ops) {
+				list.assign_range(array);
+				array.clear();
+				array.shrink_to_fit();
+				linked = true;
+				writes_since_rebalance = 0;
+			}
+			else if (linked && 400 * write_ops < WritePercent * ops) {
+				array.reserve(list.size());
+				for (auto it = list.cbegin(); it != std::default_sentinel; ++it)
+					array.push_back(*it);
+				list.clear();
+				linked = false;
+			}
+		}
+
+		std::vector<T> array;
+		list_type list;
+		std::size_t reads = 0;
+		std::size_t writes = 0;
+		std::size_t writes_since_rebalance = 0;
+		bool linked = false;
+	};
+}
+#endif
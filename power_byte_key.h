@@ -0,0 +1,90 @@
+#ifndef POWER_BYTE_KEY_H
+#define POWER_BYTE_KEY_H
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <compare>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#endif
+
+namespace kg {
+	namespace detail {
+		// Compares the bytes at 'i' as unsigned values
+		inline std::strong_ordering compare_byte_at(std::byte const* a, std::byte const* b, std::size_t i) {
+			return static_cast<unsigned char>(a[i]) <=> static_cast<unsigned char>(b[i]);
+		}
+
+		// Compares 'n' bytes like 'memcmp', with the widest compares available. A vector
+		// compare finds the first byte that differs, and only that byte is compared.
+		// Without vectors, the bytes are compared as big-endian 64-bit words.
+		inline std::strong_ordering compare_bytes(std::byte const* a, std::byte const* b, std::size_t n) {
+			std::size_t i = 0;
+#if defined(__AVX2__)
+			for (; i + 32 <= n; i += 32) {
+				__m256i const va = _mm256_loadu_si256(reinterpret_cast<__m256i const*>(a + i));
+				__m256i const vb = _mm256_loadu_si256(reinterpret_cast<__m256i const*>(b + i));
+				auto const differ = ~static_cast<std::uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(va, vb)));
+				if (differ != 0)
+					return compare_byte_at(a, b, i + std::countr_zero(differ));
+			}
+#endif
+#if defined(__AVX2__) || defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+			for (; i + 16 <= n; i += 16) {
+				__m128i const va = _mm_loadu_si128(reinterpret_cast<__m128i const*>(a + i));
+				__m128i const vb = _mm_loadu_si128(reinterpret_cast<__m128i const*>(b + i));
+				auto const differ = ~static_cast<std::uint32_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(va, vb))) & 0xffff;
+				if (differ != 0)
+					return compare_byte_at(a, b, i + std::countr_zero(differ));
+			}
+#endif
+			for (; i + 8 <= n; i += 8) {
+				std::uint64_t wa, wb;
+				std::memcpy(&wa, a + i, 8);
+				std::memcpy(&wb, b + i, 8);
+				if (wa != wb) {
+					if constexpr (std::endian::native == std::endian::little)
+						return std::byteswap(wa) <=> std::byteswap(wb);
+					else
+						return wa <=> wb;
+				}
+			}
+			for (; i < n; i++) {
+				if (a[i] != b[i])
+					return compare_byte_at(a, b, i);
+			}
+			return std::strong_ordering::equal;
+		}
+	}
+
+	// A fixed-size binary key, like a UUID or a digest. It is a 'std::array<std::byte, N>'
+	// that compares like 'memcmp', which is the same order the array has, but faster.
+	template <std::size_t N>
+	struct byte_key : std::array<std::byte, N> {
+		friend constexpr bool operator==(byte_key const& a, byte_key const& b) {
+			if consteval {
+				return std::ranges::equal(a, b);
+			}
+			else {
+				return std::memcmp(a.data(), b.data(), N) == 0;
+			}
+		}
+
+		friend constexpr std::strong_ordering operator<=>(byte_key const& a, byte_key const& b) {
+			if consteval {
+				return std::lexicographical_compare_three_way(a.begin(), a.end(), b.begin(), b.end());
+			}
+			else {
+				return detail::compare_bytes(a.data(), b.data(), N);
+			}
+		}
+	};
+}
+
+#endif // !POWER_BYTE_KEY_H
@@ -0,0 +1,354 @@
+#ifndef POWER_INTERVAL_SET_H
+#define POWER_INTERVAL_SET_H
+
+#include "scatter_allocator.h"
+#include "balance_helper.h"
+#include <cassert>
+#include <concepts>
+#include <iterator>
+#include <limits>
+#include <utility>
+#include <algorithm>
+
+namespace kg {
+	// A closed interval [first, last]
+	template <typename T>
+	struct interval {
+		T first;
+		T last;
+
+		constexpr bool operator==(interval const&) const = default;
+	};
+
+	// A set of integers stored as sorted, disjoint intervals.
+	// Overlapping or adjacent intervals are merged on insert, and split on erase,
+	// so a run of consecutive values only ever costs a single node.
+	template <std::integral T>
+	class power_interval_set {
+		struct node {
+			node* next[2];
+			interval<T> range;
+		};
+
+		using balance_helper = detail::balance_helper<node>;
+
+	public:
+		struct iterator {
+			friend class power_interval_set;
+
+			// iterator traits
+			using difference_type = ptrdiff_t;
+			using value_type = interval<T>;
+			using pointer = const interval<T>*;
+			using reference = const interval<T>&;
+			using iterator_category = std::forward_iterator_tag;
+
+			constexpr iterator() noexcept = default;
+			constexpr iterator(node* n) noexcept : curr(n) {}
+
+			constexpr iterator& operator++() {
+				assert(curr != nullptr && "Trying to step past end of list");
+				curr = curr->next[0];
+				return *this;
+			}
+
+			constexpr iterator operator++(int) {
+				iterator const retval = *this;
+				++(*this);
+				return retval;
+			}
+
+			constexpr bool operator==(std::default_sentinel_t) const {
+				return curr == nullptr;
+			}
+
+			constexpr bool operator==(iterator const& other) const {
+				return curr == other.curr;
+			}
+
+			constexpr reference operator*() const {
+				assert(curr != nullptr && "Dereferencing null");
+				return curr->range;
+			}
+
+			constexpr pointer operator->() const {
+				assert(curr != nullptr && "Dereferencing null");
+				return &curr->range;
+			}
+
+		private:
+			node* curr{};
+		};
+		using const_iterator = iterator;
+
+		constexpr power_interval_set() = default;
+
+		constexpr power_interval_set(power_interval_set const& other) {
+			for (interval<T> const& r : other)
+				append(r);
+			rebalance();
+		}
+
+		constexpr power_interval_set(power_interval_set&& other) {
+			head = std::exchange(other.head, nullptr);
+			count = other.count;
+			needs_rebalance = other.needs_rebalance;
+			alloc = std::move(other.alloc);
+			other.count = 0;
+			other.needs_rebalance = false;
+		}
+
+		constexpr ~power_interval_set() {
+			destroy_nodes();
+		}
+
+		constexpr bool operator==(power_interval_set const& other) const {
+			return count == other.count && std::ranges::equal(*this, other);
+		}
+
+		[[nodiscard]] constexpr iterator begin() const {
+			return { head };
+		}
+		[[nodiscard]] constexpr std::default_sentinel_t end() const {
+			return {};
+		}
+
+		// The number of disjoint intervals in the set
+		[[nodiscard]] constexpr std::size_t size() const {
+			return count;
+		}
+
+		[[nodiscard]] constexpr bool empty() const {
+			return nullptr == head;
+		}
+
+		[[nodiscard]] constexpr interval<T> front() const {
+			assert(!empty() && "Can not call 'front()' on an empty set");
+			return head->range;
+		}
+
+		[[nodiscard]] constexpr interval<T> back() const {
+			assert(!empty() && "Can not call 'back()' on an empty set");
+			return head->next[1]->range;
+		}
+
+		constexpr void clear() {
+			destroy_nodes();
+			alloc = scatter_allocator<node>{};
+			head = nullptr;
+			count = 0;
+			needs_rebalance = false;
+		}
+
+		constexpr void insert(T val) {
+			insert(val, val);
+		}
+
+		// Adds the values in [first, last]
+		constexpr void insert(T first, T last) {
+			assert(!(last < first) && "Invalid interval");
+			auto const [prev, curr] = locate(first);
+
+			node* merged = nullptr;
+			if (prev && touches(prev->range.last, first)) {
+				merged = prev;
+				merged->range.last = std::max(merged->range.last, last);
+			}
+			else if (curr && touches(last, curr->range.first)) {
+				merged = curr;
+				merged->range.first = first;
+				merged->range.last = std::max(merged->range.last, last);
+			}
+			else {
+				link_between(prev, curr, { first, last });
+				return;
+			}
+
+			// Swallow the intervals that the merged one now reaches
+			node* last_swallowed = nullptr;
+			for (node* n = merged->next[0]; n && touches(merged->range.last, n->range.first); n = n->next[0]) {
+				merged->range.last = std::max(merged->range.last, n->range.last);
+				last_swallowed = n;
+			}
+			if (last_swallowed)
+				unlink_run(merged, merged->next[0], last_swallowed);
+		}
+
+		constexpr void erase(T val) {
+			erase(val, val);
+		}
+
+		// Removes the values in [first, last]
+		constexpr void erase(T first, T last) {
+			assert(!(last < first) && "Invalid interval");
+			auto const [prev, curr] = locate(first);
+
+			// The interval starting before 'first' may reach into the erased range
+			if (prev && !(prev->range.last < first)) {
+				T const old_last = prev->range.last;
+				prev->range.last = first - 1;
+				if (last < old_last) {
+					// Erasing from the middle of it, so split it in two
+					link_between(prev, prev->next[0], { static_cast<T>(last + 1), old_last });
+					return;
+				}
+			}
+
+			// Remove the intervals that are covered, and trim the one that is partially covered
+			node* last_removed = nullptr;
+			for (node* n = curr; n && !(last < n->range.first); n = n->next[0]) {
+				if (last < n->range.last) {
+					n->range.first = last + 1;
+					break;
+				}
+				last_removed = n;
+			}
+			if (last_removed)
+				unlink_run(prev, curr, last_removed);
+		}
+
+		[[nodiscard]] constexpr bool contains(T const& val) const {
+			auto const [prev, curr] = locate(val);
+			if (curr && curr->range.first == val)
+				return true;
+			return prev && !(prev->range.last < val);
+		}
+
+		// Returns true if any value in [first, last] is in the set
+		[[nodiscard]] constexpr bool overlaps(T const& first, T const& last) const {
+			auto const [prev, curr] = locate(first);
+			if (prev && !(prev->range.last < first))
+				return true;
+			return curr && !(last < curr->range.first);
+		}
+
+		constexpr void rebalance() {
+			if (head && needs_rebalance) {
+				balance_helper bh(head, count);
+				while (bh)
+					bh.balance_current_and_advance();
+
+				needs_rebalance = false;
+			}
+		}
+
+	private:
+		// Two intervals can be merged if the second one starts no later than right after the first one ends
+		constexpr static bool touches(T const& a_last, T const& b_first) {
+			return !(a_last < b_first) || (a_last < std::numeric_limits<T>::max() && a_last + 1 == b_first);
+		}
+
+		// Returns the first node whose interval starts at or after 'val', and the node before it.
+		// Either can be null.
+		constexpr std::pair<node*, node*> locate(T const& val) const {
+			if (empty() || !(head->range.first < val))
+				return { nullptr, head };
+
+			node* const tail = head->next[1];
+			if (tail->range.first < val)
+				return { tail, nullptr };
+
+			node* prev = nullptr;
+			node* curr = head;
+			while (curr->range.first < val) {
+				prev = curr;
+				curr = curr->next[curr->next[1]->range.first < val];
+			}
+			return { prev, curr };
+		}
+
+		// Links a new node in after 'prev' and before 'next', either of which can be null
+		constexpr void link_between(node* prev, node* next, interval<T> range) {
+			node* n = alloc.allocate_one();
+			std::construct_at(n, node{ {next, next}, range });
+
+			if (head == nullptr) { // empty
+				n->next[1] = n;
+				head = n;
+			}
+			else if (prev == nullptr) { // before head
+				n->next[1] = head->next[1];
+				head = n;
+			}
+			else if (next == nullptr) { // after tail
+				prev->next[0] = n;
+				prev->next[1] = n;
+				head->next[1] = n;
+				n->next[1] = n;
+			}
+			else { // middle
+				// It keeps the link to 'next', a copy of the skip link of 'next'
+				// could cross the links to 'next'
+				prev->next[0] = n;
+			}
+
+			count += 1;
+			needs_rebalance = true;
+		}
+
+		// Appends an interval that starts after the current tail
+		constexpr void append(interval<T> range) {
+			link_between(empty() ? nullptr : head->next[1], nullptr, range);
+		}
+
+		// Unlinks and frees the nodes from 'first' to 'last', both inclusive.
+		// 'before' is the node in front of 'first', or null if 'first' is the head.
+		constexpr void unlink_run(node* before, node* first, node* last) {
+			node* const tail = head->next[1];
+			node* const after = last->next[0];
+
+			// Skip links from earlier nodes can point into the run, so move them
+			// to the first live node after it. Skip links do not cross, so those
+			// nodes are all on the search path for the start of the run. Nodes are
+			// ordered, so a link points into the run if its target starts within it.
+			T const lo = first->range.first;
+			T const hi = last->range.first;
+			node* const replacement = after ? after : before;
+			for (node* p = head; p->range.first < lo;) {
+				node* const following = p->next[p->next[1]->range.first < lo];
+				T const& target = p->next[1]->range.first;
+				if (!(target < lo) && !(hi < target))
+					p->next[1] = replacement;
+				p = following;
+			}
+
+			if (before) {
+				before->next[0] = after;
+				if (after == nullptr) { // 'before' is the new tail
+					before->next[1] = before;
+					head->next[1] = before;
+				}
+			}
+			else {
+				head = after;
+				if (after)
+					after->next[1] = tail;
+			}
+
+			for (node* n = first; n != after;) {
+				node* next = n->next[0];
+				std::destroy_at(n);
+				alloc.deallocate({ n, 1 });
+				count -= 1;
+				n = next;
+			}
+			needs_rebalance = true;
+		}
+
+		constexpr void destroy_nodes() {
+			node* n = head;
+			head = nullptr;
+			while (n) {
+				node* next = n->next[0];
+				std::destroy_at(n);
+				n = next;
+			}
+		}
+
+		node* head = nullptr;
+		std::size_t count : 63 = 0;
+		std::size_t needs_rebalance : 1 = false;
+		scatter_allocator<node> alloc;
+	};
+}
+#endif
@@ -0,0 +1,375 @@
+#ifndef POWER_KV_STORE_H
+#define POWER_KV_STORE_H
+
+#include "power_list.h"
+#include <cassert>
+#include <condition_variable>
+#include <cstdint>
+#include <cstring>
+#include <exception>
+#include <filesystem>
+#include <fstream>
+#include <mutex>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace kg {
+	// A key-value store on local disk. Values are appended to a data file, and an
+	// in-memory power_map maps each key to where its latest value is in the file.
+	//
+	// * Overwritten and removed values stay in the file until it is compacted. A
+	//   background thread compacts it when more than 'max_garbage_percent' of it is
+	//   garbage, by walking the index and copying the live values to a new file.
+	// * Opening an existing file replays it, and builds the index in one go.
+	// * All operations are thread-safe. Compaction only holds the lock at the start,
+	//   and at the end to copy over what was written while it ran.
+	// * If a background compaction fails, the store keeps the old file, and the next
+	//   call into it throws the error. Compaction is tried again after that.
+	// * Records are stored in native byte order, so files are not portable.
+	class power_kv_store {
+		// Where a value is in the data file
+		struct location {
+			std::uint64_t offset;
+			std::uint32_t size;
+		};
+
+		using index_type = power_map<std::string, location, power_list_options{ .deferred_erase = true }>;
+
+		// Every record starts with the key size and value size, followed by the key and value.
+		// Removals are written as records with a value size of 'tombstone'.
+		struct record_header {
+			std::uint32_t key_size;
+			std::uint32_t value_size;
+		};
+		static constexpr std::uint32_t tombstone = 0xffff'ffff;
+
+	public:
+		static constexpr std::uint8_t max_garbage_percent = 50;
+
+		// Opens the store in the file at 'path', creating it if it does not exist.
+		// A record at the end that was cut short by a crash is dropped.
+		explicit power_kv_store(std::filesystem::path path)
+			: path(std::move(path)) {
+			if (!std::filesystem::exists(this->path))
+				std::ofstream(this->path, std::ios::binary);
+			replay();
+			open();
+			compactor = std::jthread([this](std::stop_token stop) { compact_in_background(stop); });
+		}
+
+		power_kv_store(power_kv_store const&) = delete;
+		power_kv_store& operator=(power_kv_store const&) = delete;
+
+		~power_kv_store() {
+			compactor.request_stop();
+			compaction_wanted.notify_all();
+			compactor.join();
+			std::scoped_lock lock(mutex);
+			file.flush();
+		}
+
+		[[nodiscard]] std::optional<std::string> get(std::string_view key) {
+			std::scoped_lock lock(mutex);
+			raise_background_error();
+			auto const it = index.find(std::string(key));
+			if (!it)
+				return std::nullopt;
+			return read_value(it->second);
+		}
+
+		void put(std::string_view key, std::string_view value) {
+			assert(value.size() < tombstone && "Value is too large");
+			std::scoped_lock lock(mutex);
+			raise_background_error();
+			std::uint64_t const offset = append({ static_cast<std::uint32_t>(key.size()), static_cast<std::uint32_t>(value.size()) }, key, value);
+
+			std::string k(key);
+			if (auto const it = index.find(k)) {
+				garbage_bytes += record_size(k.size(), it->second.size);
+				index.remove(k);
+			}
+			index.insert({ std::move(k), { offset + sizeof(record_header) + key.size(), static_cast<std::uint32_t>(value.size()) } });
+
+			// Rebalancing is O(n), so doing it after a fixed fraction of the index is new keeps puts O(1) amortized
+			inserts_since_rebalance += 1;
+			if (inserts_since_rebalance > index.size() / 32 + 64) {
+				index.rebalance();
+				inserts_since_rebalance = 0;
+			}
+			maybe_compact();
+		}
+
+		// Removes 'key', and returns whether it was there
+		bool remove(std::string_view key) {
+			std::scoped_lock lock(mutex);
+			raise_background_error();
+			std::string const k(key);
+			auto const it = index.find(k);
+			if (!it)
+				return false;
+
+			append({ static_cast<std::uint32_t>(key.size()), tombstone }, key, {});
+			garbage_bytes += record_size(k.size(), it->second.size) + record_size(k.size(), 0);
+			index.remove(k);
+			maybe_compact();
+			return true;
+		}
+
+		// Calls 'fn(key, value)' with each key in [lo, hi] in order.
+		// The store is locked for the duration, so 'fn' must not call back into it.
+		void scan(std::string_view lo, std::string_view hi, auto&& fn) {
+			std::scoped_lock lock(mutex);
+			raise_background_error();
+			std::string const hi_key(hi);
+			for (auto it = index.lower_bound(std::string(lo)); it && !(hi_key < it->first); ++it)
+				fn(std::string_view(it->first), std::string_view(read_value(it->second)));
+		}
+
+		[[nodiscard]] std::size_t size() {
+			std::scoped_lock lock(mutex);
+			raise_background_error();
+			return index.size();
+		}
+
+		// Writes buffered records to the file
+		void flush() {
+			std::scoped_lock lock(mutex);
+			raise_background_error();
+			file.flush();
+		}
+
+		// Compacts the data file now, instead of waiting for the background thread
+		void compact() {
+			std::scoped_lock lock(compaction_mutex);
+			{
+				std::scoped_lock index_lock(mutex);
+				raise_background_error();
+			}
+			compact_now();
+		}
+
+	private:
+		static constexpr std::uint64_t record_size(std::size_t key_size, std::size_t value_size) {
+			return sizeof(record_header) + key_size + value_size;
+		}
+
+		void open() {
+			file.open(path, std::ios::in | std::ios::out | std::ios::binary | std::ios::app);
+			if (!file)
+				throw std::runtime_error("power_kv_store: can not open " + path.string());
+		}
+
+		// Appends a record and returns its offset
+		std::uint64_t append(record_header header, std::string_view key, std::string_view value) {
+			std::uint64_t const offset = file_bytes;
+			file.seekp(0, std::ios::end);
+			file.write(reinterpret_cast<char const*>(&header), sizeof(header));
+			file.write(key.data(), static_cast<std::streamsize>(key.size()));
+			file.write(value.data(), static_cast<std::streamsize>(value.size()));
+			if (!file)
+				throw std::runtime_error("power_kv_store: can not write to " + path.string());
+			file_bytes += record_size(key.size(), value.size());
+			return offset;
+		}
+
+		std::string read_value(location loc) {
+			std::string value(loc.size, '\0');
+			file.seekg(static_cast<std::streamoff>(loc.offset));
+			file.read(value.data(), loc.size);
+			if (!file)
+				throw std::runtime_error("power_kv_store: can not read from " + path.string());
+			return value;
+		}
+
+		// Reads the records in [offset, end) and passes each to 'fn(offset, header, key)'.
+		// Returns where the last complete record ends.
+		static std::uint64_t read_records(std::istream& in, std::uint64_t offset, std::uint64_t end, auto&& fn) {
+			in.seekg(static_cast<std::streamoff>(offset));
+			record_header header;
+			std::string key;
+			while (offset + sizeof(header) <= end && in.read(reinterpret_cast<char*>(&header), sizeof(header))) {
+				std::uint64_t const value_size = header.value_size == tombstone ? 0 : header.value_size;
+				std::uint64_t const size = record_size(header.key_size, value_size);
+				if (offset + size > end)
+					break;
+
+				key.resize(header.key_size);
+				if (!in.read(key.data(), header.key_size) || !in.seekg(static_cast<std::streamoff>(value_size), std::ios::cur))
+					break;
+				fn(offset, header, key);
+				offset += size;
+			}
+			return offset;
+		}
+
+		// Rebuilds the index from the data file. The newest record of each key wins.
+		void replay() {
+			struct entry {
+				std::string key;
+				location loc;
+				bool removed;
+			};
+			std::vector<entry> entries;
+
+			std::uint64_t const end = std::filesystem::file_size(path);
+			std::ifstream in(path, std::ios::binary);
+			std::uint64_t const valid = read_records(in, 0, end, [&](std::uint64_t offset, record_header header, std::string const& key) {
+				entries.push_back({ key, { offset + sizeof(header) + key.size(), header.value_size }, header.value_size == tombstone });
+				});
+			in.close();
+			if (valid != end)
+				std::filesystem::resize_file(path, valid);
+
+			// Keep the last record of each key, and drop the removed ones
+			std::ranges::stable_sort(entries, {}, &entry::key);
+			std::vector<std::pair<std::string, location>> live;
+			std::uint64_t live_bytes = 0;
+			for (std::size_t i = 0; i < entries.size(); i++) {
+				if (i + 1 < entries.size() && entries[i + 1].key == entries[i].key)
+					continue;
+				if (!entries[i].removed) {
+					live_bytes += record_size(entries[i].key.size(), entries[i].loc.size);
+					live.emplace_back(std::move(entries[i].key), entries[i].loc);
+				}
+			}
+
+			index.assign_range(live);
+			file_bytes = valid;
+			garbage_bytes = valid - live_bytes;
+		}
+
+		// Throws the error of a failed background compaction, once.
+		// Requires 'mutex' to be locked.
+		void raise_background_error() {
+			if (background_error)
+				std::rethrow_exception(std::exchange(background_error, nullptr));
+		}
+
+		void maybe_compact() {
+			if (garbage_bytes * 100 > file_bytes * max_garbage_percent)
+				compaction_wanted.notify_one();
+		}
+
+		// An exception that leaves this thread ends the program, so it is kept for the next
+		// call into the store to throw. No compaction starts until that call has thrown it.
+		void compact_in_background(std::stop_token stop) {
+			while (!stop.stop_requested()) {
+				{
+					std::unique_lock lock(mutex);
+					compaction_wanted.wait(lock, stop, [&] { return !background_error && garbage_bytes * 100 > file_bytes * max_garbage_percent; });
+				}
+				if (stop.stop_requested())
+					return;
+
+				std::scoped_lock lock(compaction_mutex);
+				try {
+					compact_now();
+				}
+				catch (...) {
+					std::scoped_lock index_lock(mutex);
+					background_error = std::current_exception();
+				}
+			}
+		}
+
+		// Copies the live values to a new file, and switches over to it. The old file
+		// and index stay in use if it throws. Requires 'compaction_mutex' to be locked.
+		void compact_now() {
+			std::filesystem::path const new_path = path.string() + ".compact";
+
+			// Walk the index while locked, and remember where the file ended
+			std::vector<std::pair<std::string, location>> live;
+			std::uint64_t snapshot_end;
+			{
+				std::scoped_lock lock(mutex);
+				if (garbage_bytes == 0)
+					return;
+				file.flush();
+				snapshot_end = file_bytes;
+				live.reserve(index.size());
+				for (auto const& [key, loc] : index)
+					live.emplace_back(key, loc);
+			}
+
+			// Copy the live values without holding the lock. Nothing before 'snapshot_end' changes.
+			std::ifstream in(path, std::ios::binary);
+			std::ofstream out(new_path, std::ios::binary | std::ios::trunc);
+			std::uint64_t out_bytes = 0;
+			std::string value;
+			for (auto& [key, loc] : live) {
+				value.resize(loc.size);
+				in.seekg(static_cast<std::streamoff>(loc.offset));
+				in.read(value.data(), loc.size);
+
+				record_header const header{ static_cast<std::uint32_t>(key.size()), loc.size };
+				out.write(reinterpret_cast<char const*>(&header), sizeof(header));
+				out.write(key.data(), static_cast<std::streamsize>(key.size()));
+				out.write(value.data(), static_cast<std::streamsize>(value.size()));
+				loc.offset = out_bytes + sizeof(header) + key.size();
+				out_bytes += record_size(key.size(), loc.size);
+			}
+			if (!in || !out)
+				throw std::runtime_error("power_kv_store: can not compact " + path.string());
+
+			std::scoped_lock lock(mutex);
+			index_type compacted(live);
+			std::uint64_t garbage = 0;
+
+			// Carry over what was written while copying, and apply it to the new index
+			file.flush();
+			in.clear();
+			read_records(in, snapshot_end, file_bytes, [&](std::uint64_t offset, record_header header, std::string const& key) {
+				std::uint64_t const value_size = header.value_size == tombstone ? 0 : header.value_size;
+				std::string record(record_size(key.size(), value_size), '\0');
+				in.seekg(static_cast<std::streamoff>(offset));
+				in.read(record.data(), static_cast<std::streamsize>(record.size()));
+				out.write(record.data(), static_cast<std::streamsize>(record.size()));
+
+				if (auto const it = compacted.find(key)) {
+					garbage += record_size(key.size(), it->second.size);
+					compacted.remove(key);
+				}
+				if (header.value_size == tombstone)
+					garbage += record.size();
+				else
+					compacted.insert({ key, { out_bytes + sizeof(header) + key.size(), header.value_size } });
+				out_bytes += record.size();
+				});
+			in.close();
+			out.close();
+			if (!out)
+				throw std::runtime_error("power_kv_store: can not compact " + path.string());
+
+			// The old file is opened again if it can not be replaced
+			file.close();
+			std::error_code error;
+			std::filesystem::rename(new_path, path, error);
+			open();
+			if (error)
+				throw std::filesystem::filesystem_error("power_kv_store: can not compact", new_path, path, error);
+			index = std::move(compacted);
+			file_bytes = out_bytes;
+			garbage_bytes = garbage;
+		}
+
+		std::filesystem::path path;
+		std::fstream file;
+		index_type index;
+		std::uint64_t file_bytes = 0;
+		std::uint64_t garbage_bytes = 0; // bytes of overwritten and removed records
+		std::size_t inserts_since_rebalance = 0;
+		std::exception_ptr background_error; // thrown by the next call
+
+		std::mutex mutex;
+		std::mutex compaction_mutex; // held while compacting
+		std::condition_variable_any compaction_wanted;
+		std::jthread compactor;
+	};
+}
+
+#endif // !POWER_KV_STORE_H
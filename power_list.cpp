@@ -1,9 +1,38 @@
 ﻿#include <ranges>
 #include "power_list.h"
+#include "power_interval_set.h"
+#include "intrusive_power_list.h"
+#include "power_multi_index.h"
+#include "power_adaptive_list.h"
+#include "power_versioned_list.h"
+#include "power_list_algorithms.h"
+#include "power_kv_store.h"
+#include "power_morton.h"
+#include "power_normalized_key.h"
+#include "power_byte_key.h"
+#include "power_string_list.h"
+#include <thread>
+#include <fstream>
 #include "unittest.h"
 
 using namespace kg;
 
+struct order {
+	int id;
+	double price;
+};
+
+struct trade {
+	int id;
+	int timestamp;
+	double price;
+};
+
+struct pooled_item {
+	int id;
+	power_list_hook<pooled_item> hook;
+};
+
 int main() {
 	UNITTEST(std::ranges::sized_range<power_list<int>>, "power_list must conform to sized_range concept");
 
@@ -166,6 +195,24 @@ int main() {
 		return 2 == list.size();
 		}(), "Remove middle");
 
+	UNITTEST([] {
+		power_list<int> list(std::views::iota(0, 40));
+		for (int v : { 5, 5, 17, 39, 39 })
+			list.insert(v);
+		for (int v : { 39, 5, 20, 0, 39, 17, 5, 38, 5, 17, 1 })
+			list.remove(v);
+
+		std::vector<int> expected;
+		for (int v : std::views::iota(2, 38)) {
+			if (v != 5 && v != 17 && v != 20)
+				expected.push_back(v);
+		}
+		expected.push_back(39);
+		for (int v : std::views::iota(0, 40))
+			assert(list.contains(v) == (std::ranges::find(expected, v) != expected.end()));
+		return std::ranges::equal(list, expected);
+		}(), "Remove equal keys and inserted elements without rebalancing");
+
 	UNITTEST([] {
 		auto const iota = std::views::iota(-20, 20);
 		power_list<int> list;
@@ -186,6 +233,50 @@ int main() {
 		return sum > 0 && list.contains(1);
 		}(), "Implicit rebalance");
 
+	UNITTEST([] {
+		int compares = 0;
+		struct counted_key {
+			int value;
+			int* compares;
+			constexpr bool operator==(counted_key const& other) const {
+				*compares += 1;
+				return value == other.value;
+			}
+			constexpr std::strong_ordering operator<=>(counted_key const& other) const {
+				*compares += 1;
+				return value <=> other.value;
+			}
+		};
+
+		power_list<counted_key> list;
+		for (int i = 0; i < 1000; i++)
+			list.insert({ (i * 77) % 1000, &compares });
+		list.rebalance();
+
+		// A step compares with the next node and with the target of the skip link
+		int const most = 2 * (std::bit_width(1000u) + 2) + 4;
+		for (int i = 0; i < 1000; i++) {
+			compares = 0;
+			if (!list.contains({ i, &compares }) || compares > most)
+				return false;
+		}
+		return true;
+		}(), "Rebalanced searches take about log2(n) steps");
+
+	UNITTEST([] {
+		for (int n = 1; n <= 40; n++) {
+			power_list<int> list(std::views::iota(0, n));
+			list.insert(n / 2);
+			list.remove(n / 2);
+			list.rebalance();
+			for (int v : std::views::iota(0, n))
+				assert(list.contains(v));
+			if (list.contains(-1) || list.contains(n) || list.size() != static_cast<std::size_t>(n))
+				return false;
+		}
+		return true;
+		}(), "Rebalancing lists of every size");
+
 	UNITTEST([] {
 		auto const iota = std::views::iota(0, 20);
 		power_list<int> list1(iota);
@@ -202,5 +293,796 @@ int main() {
 		return true;
 		}(), "Comparison operator");
 
+	UNITTEST([] {
+		power_list<int> list(std::views::iota(0, 100) | std::views::transform([](int v) { return v * 2; }));
+		std::vector<int> probes;
+		for (int v = -5; v < 205; v += 3)
+			probes.push_back(v);
+		std::uint64_t mask[4]{};
+		list.contains_batch(probes, mask);
+		for (std::size_t i = 0; i < probes.size(); i++) {
+			bool const bit = (mask[i / 64] >> (i % 64)) & 1;
+			if (bit != list.contains(probes[i]))
+				return false;
+		}
+		return true;
+		}(), "Batched contains, sorted probes");
+
+	UNITTEST([] {
+		power_list<int> list(std::views::iota(0, 20));
+		int const probes[] = { 19, -1, 4, 4, 30, 0, 7 };
+		std::uint64_t mask[1]{};
+		list.contains_batch(probes, mask);
+		return mask[0] == 0b1101101;
+		}(), "Batched contains, unsorted probes");
+
+	UNITTEST([] {
+		power_interval_set<int> set;
+		set.insert(10, 19);
+		set.insert(30, 39);
+		set.insert(20, 29); // bridges the two
+		set.insert(41);
+		return set.size() == 2 && set.front() == interval{ 10, 39 } && set.back() == interval{ 41, 41 };
+		}(), "Interval set coalesces on insert");
+
+	UNITTEST([] {
+		power_interval_set<int> set;
+		set.insert(0, 99);
+		set.erase(40, 59);
+		set.erase(90, 120);
+		return set.size() == 2
+			&& set.contains(39) && !set.contains(40) && !set.contains(59) && set.contains(60)
+			&& set.contains(89) && !set.contains(90);
+		}(), "Interval set splits on erase");
+
+	UNITTEST([] {
+		power_interval_set<int> set;
+		for (int v : std::views::iota(0, 20))
+			set.insert(v * 10, v * 10 + 4);
+		set.rebalance();
+		return set.overlaps(3, 7) && set.overlaps(8, 12) && !set.overlaps(5, 9) && !set.overlaps(195, 300);
+		}(), "Interval set overlaps");
+
+	UNITTEST([] {
+		power_list<order, &order::id> list;
+		list.insert({ 3, 30.0 });
+		list.insert({ 1, 10.0 });
+		list.insert({ 2, 20.0 });
+		auto const it = list.find(2);
+		return it && it->price == 20.0 && list.front().id == 1 && list.back().id == 3 && !list.contains(4);
+		}(), "Projection to a member");
+
+	UNITTEST([] {
+		constexpr auto descending = [](int v) { return -v; };
+		power_list<int, descending> list(std::views::iota(0, 10) | std::views::reverse);
+		list.remove(-4);
+		return list.front() == 9 && list.contains(-9) && !list.contains(-4) && list.size() == 9;
+		}(), "Projection through a functor");
+
+	UNITTEST([] {
+		pooled_item items[16];
+		intrusive_power_list<pooled_item, &pooled_item::hook, &pooled_item::id> list;
+		for (int i = 0; i < 16; i++) {
+			items[i].id = (i * 7) % 16; // scrambled insertion order
+			list.insert(items[i]);
+		}
+		list.rebalance();
+		list.erase(items[3]);
+		list.erase(items[0]);
+
+		int expected = 1;
+		for (pooled_item const& item : list) {
+			expected += (expected == items[3].id);
+			if (item.id != expected++)
+				return false;
+		}
+		return list.size() == 14 && !list.contains(items[3].id) && list.find(9) == &items[15];
+		}(), "Intrusive list");
+
+	UNITTEST([] {
+		using list_type = intrusive_power_list<pooled_item, &pooled_item::hook, &pooled_item::id>;
+		pooled_item items[6]{ { 1 }, { 2 }, { 3 }, { 2 }, { 3 }, { 4 } };
+		list_type a, b;
+		for (int i = 0; i < 3; i++) {
+			a.insert(items[i]);
+			b.insert(items[i + 3]);
+		}
+
+		std::vector<pooled_item const*> both, either;
+		set_intersection(a, b, [&](pooled_item const& item) { both.push_back(&item); });
+		set_union(a, b, [&](pooled_item const& item) { either.push_back(&item); });
+		if (both != std::vector<pooled_item const*>{ &items[1], &items[2] } || either != std::vector<pooled_item const*>{ &items[0], &items[1], &items[2], &items[5] })
+			return false;
+
+		// Moving 'b' over 'a' unlinks the objects of 'a', so they can be linked in again
+		a = std::move(b);
+		if (items[0].hook.next[0] || items[0].hook.next[1] || a.size() != 3 || !b.empty())
+			return false;
+		b.insert(items[0]);
+		return b.contains(1) && !a.contains(1) && a.contains(4);
+		}(), "Intrusive set operations and move assignment");
+
+	UNITTEST([] {
+		power_multi_index<trade, &trade::id, &trade::timestamp, &trade::price> trades;
+		trades.insert({ 1, 30, 9.5 });
+		trades.insert({ 2, 10, 7.5 });
+		trades.insert({ 3, 20, 8.5 });
+
+		auto by_time = trades.get<1>();
+		auto by_price = trades.get<2>();
+		if (by_time.begin()->id != 2 || by_price.lower_bound(8.0)->id != 3)
+			return false;
+
+		// Erasing through one index removes it from the others
+		by_price.erase(by_price.find(9.5));
+		return trades.size() == 2 && !trades.get<0>().contains(1) && !by_time.contains(30);
+		}(), "Multi-index container");
+
+	UNITTEST([] {
+		power_adaptive_list<int, std::identity{}, 25, 8> list(std::views::iota(0, 10));
+		if (list.is_linked())
+			return false;
+
+		// A burst of writes moves it to the linked representation
+		for (int v : std::views::iota(20, 28))
+			list.insert(v);
+		if (!list.is_linked() || !list.contains(25))
+			return false;
+
+		// A stretch of reads moves it back to the array
+		for (int v : std::views::iota(0, 8))
+			(void)list.contains(v);
+		list.remove(3);
+
+		int sum = 0;
+		for (int v : list)
+			sum += v;
+		return !list.is_linked() && list.size() == 17 && sum == 45 - 3 + 188 && *list.lower_bound(11) == 20;
+		}(), "Adaptive representation");
+
+	UNITTEST([] {
+		// A quarter of 2 percent is less than one percent
+		power_adaptive_list<int, std::identity{}, 2, 100> list;
+		for (int v : std::views::iota(0, 100))
+			list.insert(v);
+		if (!list.is_linked())
+			return false;
+
+		for (int v : std::views::iota(0, 100))
+			(void)list.contains(v);
+		return !list.is_linked() && list.size() == 100;
+		}(), "Adaptive representation with a small write percent");
+
+	UNITTEST([] {
+		int compares = 0;
+		struct counted_key {
+			int value;
+			int* compares;
+			constexpr bool operator==(counted_key const& other) const {
+				*compares += 1;
+				return value == other.value;
+			}
+			constexpr std::strong_ordering operator<=>(counted_key const& other) const {
+				*compares += 1;
+				return value <=> other.value;
+			}
+		};
+		auto const compares_to_find = [&](auto& list, int value) {
+			compares = 0;
+			return list.contains({ value, &compares }) ? compares : -1;
+		};
+
+		// Appends leave every skip link pointing at the next node, until a rebalance
+		power_adaptive_list<counted_key, std::identity{}, 10, 64> list;
+		for (int i = 0; i < 1000; i++)
+			list.insert({ i, &compares });
+		if (!list.is_linked())
+			return false;
+		int const most = 2 * (std::bit_width(1000u) + 2) + 4;
+		int const found_early = compares_to_find(list, 500);
+
+		list.rebalance();
+		for (int i = 0; i < 1000; i += 37) {
+			int const found = compares_to_find(list, i);
+			if (found < 0 || found > most)
+				return false;
+		}
+		return found_early >= 0 && found_early <= most;
+		}(), "Adaptive representation rebalances the linked list");
+
+	UNITTEST([] {
+		power_list<int, std::identity{}, power_list_options{ .deferred_erase = true, .max_dead_percent = 50 }> list(std::views::iota(0, 10));
+		list.remove(0);
+		list.remove(4);
+		list.remove(9);
+		if (list.size() != 7 || list.contains(4) || list.front() != 1 || list.back() != 8 || *list.lower_bound(4) != 5)
+			return false;
+
+		int sum = 0;
+		for (int v : list)
+			sum += v;
+		if (sum != 45 - 13)
+			return false;
+
+		// Reinserting revives the dead node, and crossing the threshold purges the rest
+		list.insert(4);
+		for (int v : { 1, 2, 3, 5, 6 })
+			list.remove(v);
+		return list.size() == 3 && list.contains(4) && list.contains(7) && list.contains(8);
+		}(), "Deferred erase");
+
+	RUNTIME_UNITTEST([] {
+		power_versioned_list<int> list;
+		for (int v : std::views::iota(0, 10))
+			list.insert(v);
+
+		auto before = list.read();
+		list.remove(3);
+		list.insert(10);
+		list.collect();
+		auto const after = list.read();
+		if (!before.contains(3) || before.contains(10) || after.contains(3) || !after.contains(10))
+			return false;
+
+		// Once the old view is closed, its versions can be collected
+		int sum = 0;
+		before.scan(2, 4, [&](int v) { sum += v; });
+		{ auto const moved = std::move(before); }
+		list.collect();
+		return sum == 9 && list.size() == 10 && list.insert(3) && !list.insert(3);
+		}(), "Versioned reads");
+
+	RUNTIME_UNITTEST([] {
+		// A writer slides a window of 64 keys forward while readers check that
+		// every view sees one unbroken window, and sees the same one every time.
+		power_versioned_list<int> list;
+		std::atomic<bool> done = false;
+		std::atomic<bool> consistent = true;
+
+		auto reader = [&] {
+			while (!done) {
+				auto const view = list.read();
+				std::vector<int> first_pass, second_pass;
+				std::ranges::copy(view, std::back_inserter(first_pass));
+				std::ranges::copy(view, std::back_inserter(second_pass));
+				bool const unbroken = std::ranges::adjacent_find(first_pass, [](int a, int b) { return b != a + 1; }) == first_pass.end();
+				if (!unbroken || first_pass.size() > 64 || first_pass != second_pass)
+					consistent = false;
+			}
+		};
+		std::jthread readers[] = { std::jthread(reader), std::jthread(reader), std::jthread(reader) };
+
+		for (int v : std::views::iota(0, 20'000)) {
+			list.insert(v);
+			if (v >= 63)
+				list.remove(v - 63);
+			if (v % 128 == 0)
+				list.collect();
+		}
+		done = true;
+		for (auto& r : readers)
+			r.join();
+		list.collect();
+		return consistent && list.size() == 63 && list.read().find(19'999) != nullptr;
+		}(), "Versioned reads under concurrent updates");
+
+	UNITTEST([] {
+		power_list<int> const a(std::vector{ 1, 3, 5, 7, 9, 11 });
+		power_list<int> const b(std::vector{ 2, 3, 4, 5, 11, 12 });
+		return set_intersection(a, b) == power_list<int>(std::vector{ 3, 5, 11 })
+			&& set_union(a, b) == power_list<int>(std::vector{ 1, 2, 3, 4, 5, 7, 9, 11, 12 })
+			&& set_intersection(a, power_list<int>{}).empty();
+		}(), "Set operations");
+
+	RUNTIME_UNITTEST([] {
+		// Multiples of 2 and of 3, large enough to be split across threads
+		power_list<int> const a(std::views::iota(0, 1'000'000) | std::views::transform([](int v) { return 2 * v; }));
+		power_list<int> const b(std::views::iota(0, 600'000) | std::views::transform([](int v) { return 3 * v; }));
+		auto const both = set_intersection(par, a, b);
+		auto const either = set_union(par, a, b);
+		return both == set_intersection(a, b) && either == set_union(a, b)
+			&& both.size() == 300'000 && either.size() == 1'300'000;
+		}(), "Parallel set operations");
+
+	UNITTEST([] {
+		power_list<order, &order::id> const list(std::vector<order>{ { 1, 9.5 }, { 4, 7.5 }, { 6, 8.5 } });
+		int const probes[] = { 6, 0, 4, 7, 6 };
+		order const* results[5]{};
+		find_batch(list, probes, results);
+		return results[0]->price == 8.5 && !results[1] && results[2]->price == 7.5 && !results[3] && results[4] == results[0];
+		}(), "Batched find");
+
+	RUNTIME_UNITTEST([] {
+		power_list<int> const list(std::views::iota(0, 1'000'000) | std::views::transform([](int v) { return 2 * v; }));
+
+		// Unsorted probes, about half of them in the list
+		std::vector<int> probes(500'000);
+		for (std::size_t i = 0; i < probes.size(); i++)
+			probes[i] = static_cast<int>((i * 7919) % 2'100'000);
+		std::vector<int const*> results(probes.size());
+		find_batch(par, list, probes, results);
+
+		for (std::size_t i = 0; i < probes.size(); i++) {
+			bool const expected = probes[i] % 2 == 0 && probes[i] < 2'000'000;
+			if (expected != (results[i] != nullptr) || (results[i] && *results[i] != probes[i]))
+				return false;
+		}
+		return true;
+		}(), "Parallel batched find");
+
+	UNITTEST([] {
+		power_list<int, std::identity{}, power_list_options{ .deferred_erase = true, .max_dead_percent = 50 }> list(std::views::iota(0, 40));
+		list.remove(0);
+		list.remove(17);
+		int sum = 0, count = 0;
+		for (int v : list.prefetched<4>()) {
+			sum += v;
+			count += 1;
+		}
+		return count == 38 && sum == 780 - 17;
+		}(), "Prefetching iteration");
+
+	RUNTIME_UNITTEST([] {
+		scatter_allocator<int> alloc;
+		std::span<int> const block = alloc.allocate(1024)[0];
+		alloc.deallocate(block.subspan(100, 1));
+		alloc.deallocate(block.subspan(900, 1));
+
+		// The slot freed last is further from the hint, so the other one is picked
+		return alloc.allocate_near(&block[101]) == &block[100] && alloc.allocate_near(&block[101]) == &block[900];
+		}(), "Allocation near a hint");
+
+	UNITTEST([] {
+		power_list<int, std::identity{}, power_list_options{ .deferred_erase = true, .max_dead_percent = 50 }> list;
+		for (int v : { 5, 1, 9, 3, 7, 2, 8 })
+			list.insert(v);
+		list.remove(9);
+		list.remove(1);
+		list.rebalance(relocate);
+		if (list.size() != 5 || !list.contains(7) || list.contains(9) || list.front() != 2 || list.back() != 8 || *list.lower_bound(4) != 5)
+			return false;
+
+		// Down to one and two live elements
+		for (int v : { 2, 5, 8 })
+			list.remove(v);
+		list.rebalance(relocate);
+		bool const two = list.size() == 2 && list.front() == 3 && list.back() == 7 && list.contains(7) && !list.contains(5);
+		list.remove(3);
+		list.rebalance(relocate);
+		power_list<int> single(std::vector{ 5 });
+		single.rebalance(relocate);
+		return two && list.size() == 1 && list.front() == 7 && list.contains(7) && single.size() == 1 && single.contains(5);
+		}(), "Relocating rebalance");
+
+	RUNTIME_UNITTEST([] {
+		power_list<int> list;
+		for (int v : std::views::iota(0, 1000))
+			list.insert((v * 7) % 1000);
+		list.rebalance(relocate);
+
+		// Memory order matches list order
+		int const* prev = nullptr;
+		for (auto it = list.cbegin(); it; ++it) {
+			int const* const curr = it.operator->();
+			if (prev && reinterpret_cast<std::uintptr_t>(curr) <= reinterpret_cast<std::uintptr_t>(prev))
+				return false;
+			prev = curr;
+		}
+		return list.size() == 1000 && list.find(999);
+		}(), "Relocated nodes are in list order");
+
+	UNITTEST([] {
+		using list_type = power_list<int, std::identity{}, power_list_options{ .fingerprint = true }>;
+		list_type a(std::vector{ 1, 2, 3, 4 });
+		list_type b;
+		for (int v : { 4, 2, 3, 1 })
+			b.insert(v);
+		if (a != b || a.hash() != b.hash() || std::hash<list_type>{}(a) != a.hash())
+			return false;
+
+		b.remove(3);
+		b.insert(5);
+		return a != b && a.hash() != b.hash() && a.size() == b.size();
+		}(), "Fingerprint");
+
+	UNITTEST([] {
+		using list_type = power_list<int, std::identity{}, power_list_options{ .merkle = true }>;
+		list_type a(std::views::iota(0, 200));
+		list_type b(std::views::iota(0, 200));
+		if (!diff(a, b).empty())
+			return false;
+
+		a.remove(13);
+		b.remove(150);
+		b.insert(500);
+		return diff(a, b) == std::vector{ 13, 150, 500 };
+		}(), "Merkle diff");
+
+	UNITTEST([] {
+		// The sums follow inserts and erases without a rebalance, also at both ends and among equal keys
+		using list_type = power_list<int, std::identity{}, power_list_options{ .merkle = true }>;
+		list_type const a(std::vector{ 0, 1, 2, 3, 3, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15, 16, 17, 18, 19 });
+		list_type b(a);
+		b.erase(std::next(b.lower_bound(3)));
+		b.remove(0);
+		b.remove(19);
+		b.insert(3);
+		b.insert(-1);
+		b.insert(20);
+		b.remove(7);
+		if (diff(a, b) != std::vector{ -1, 0, 7, 19, 20 })
+			return false;
+
+		b.insert(0);
+		b.insert(7);
+		b.insert(19);
+		b.remove(-1);
+		b.remove(20);
+		return diff(a, b).empty() && diff(b, a).empty();
+		}(), "Merkle diff after changes");
+
+	UNITTEST([] {
+		using list_type = power_list<int, std::identity{}, power_list_options{ .deferred_erase = true, .merkle = true }>;
+		list_type a(std::views::iota(0, 100));
+		list_type b(std::views::iota(0, 100));
+		b.remove(40);
+		b.remove(41);
+		if (diff(a, b) != std::vector{ 40, 41 })
+			return false;
+
+		// A revived node is counted again
+		b.insert(41);
+		return diff(a, b) == std::vector{ 40 };
+		}(), "Merkle diff with dead nodes");
+
+	UNITTEST([] {
+		using list_type = power_list<int, std::identity{}, power_list_options{ .deferred_erase = true, .ttl = true }>;
+		list_type list(std::views::iota(0, 8));
+		for (int i = 8; i < 16; i++)
+			list.insert(i, 100 + i);
+		list.insert(20, 200);
+		if (list.reap(50) != 0 || list.size() != 17)
+			return false;
+
+		// Lookups that are given the time do not wait for 'reap'
+		if (list.contains(9, 111) || !list.contains(9, 108) || !list.contains(7, 1000) || *list.lower_bound(8, 111) != 12 || !list.contains(9))
+			return false;
+
+		// 8..11 expire, and 8 comes back without a deadline
+		if (list.reap(111) != 4 || list.contains(9) || !list.contains(12) || list.size() != 13)
+			return false;
+		list.insert(8);
+
+		// 12..15 expire, which is enough to sweep
+		if (list.reap(150) != 4 || list.size() != 10 || list.reap(150) != 0)
+			return false;
+		list.rebalance(relocate);
+		return list.reap(1000) == 1 && std::ranges::equal(list, std::views::iota(0, 9));
+		}(), "Expiry");
+
+	UNITTEST([] {
+		power_list<std::string> list(std::vector<std::string>{ "ab", "abc", "abd", "abz", "ac", "b", "b\xff", "b\xff\xff", "c" });
+		list.remove("abd");
+		auto const as_vector = [](auto range) { return std::vector<std::string>(range.begin(), range.end()); };
+		if (as_vector(list.prefix_range("ab")) != std::vector<std::string>{ "ab", "abc", "abz" }
+			|| as_vector(list.prefix_range("b\xff")) != std::vector<std::string>{ "b\xff", "b\xff\xff" }
+			|| !list.prefix_range("aa").empty() || !list.prefix_range("d").empty() || as_vector(list.prefix_range("")).size() != 8)
+			return false;
+
+		std::string_view const prefixes[] = { "c", "abc", "a", "zz", "b" };
+		auto const ranges = list.prefix_ranges(prefixes);
+		return std::ranges::distance(ranges[0]) == 1 && std::ranges::distance(ranges[1]) == 1 && std::ranges::distance(ranges[2]) == 4
+			&& ranges[3].empty() && std::ranges::distance(ranges[4]) == 3;
+		}(), "Prefix ranges");
+
+	UNITTEST([] {
+		using z = morton<2>;
+		if (z::encode({ 3, 5 }) != 0b100111 || z::decode(0b100111) != z::point{ 3, 5 })
+			return false;
+
+		// BIGMIN and LITMAX agree with walking the codes one by one
+		z::box const box{ { 2, 1 }, { 5, 6 } };
+		for (std::uint64_t code = 0; code < 64; code++) {
+			std::uint64_t up = code + 1, down = code - 1;
+			while (up < 64 && !box.contains(up))
+				up++;
+			while (down < 64 && !box.contains(down))
+				down--;
+			if ((up < 64 && z::bigmin(code, box) != up) || (down < 64 && code > 0 && z::litmax(code, box) != down) || z::code_box(box).contains(code) != box.contains(code))
+				return false;
+		}
+
+		power_list<std::uint64_t> points;
+		for (std::uint32_t x = 0; x < 16; x += 1)
+			for (std::uint32_t y = 0; y < 16; y += 1)
+				points.insert(z::encode({ x, y }));
+		points.rebalance();
+
+		int found = 0;
+		morton_box_query<2>(points, box, [&](std::uint64_t code) { found += box.contains(code) ? 1 : 100; });
+		int found_in_one_run = 0;
+		morton_box_query<2>(points, box, [&](std::uint64_t code) { found_in_one_run += box.contains(code) ? 1 : 100; }, 1);
+		return found == 4 * 6 && found_in_one_run == 4 * 6 && z::ranges(box).size() > 1 && z::ranges({ { 4, 4 }, { 7, 7 } }).size() == 1;
+		}(), "Morton box queries");
+
+	RUNTIME_UNITTEST([] {
+		// Inserting strings is not a constant expression in every standard library
+		using list_type = power_list<std::string, std::identity{}, power_list_options{ .deferred_erase = true, .key_prefix = true }>;
+		std::string const a_nul("a\0", 2);
+		list_type list(std::vector<std::string>{ "", "a", a_nul, "abcdefgh", "abcdefgh1", "abcdefgh2", "abcdefgi", "b" });
+		list.insert("abcdefgh15");
+		list.remove("abcdefgh2");
+		for (std::string const& key : { std::string(""), std::string("a"), a_nul, std::string("abcdefgh"), std::string("abcdefgh1"), std::string("abcdefgh15"), std::string("abcdefgi"), std::string("b") }) {
+			if (!list.contains(key))
+				return false;
+		}
+		return !list.contains("abcdefgh2") && !list.contains("abcdefg") && !list.contains("c")
+			&& *list.lower_bound("abcdefgh16") == "abcdefgi" && *list.lower_bound(std::string("a\0\1", 3)) == "abcdefgh";
+		}(), "Key prefixes");
+
+	UNITTEST([] {
+		// Sorted by 'operator<', so the encodings must come out sorted too
+		using key = std::tuple<int, std::string_view, double>;
+		key const keys[] = { { -5, "b", 1.0 }, { -1, "", -2.0 }, { -1, "", 0.0 }, { -1, "a", -1e300 }, { -1, std::string_view("a\0", 2), -3.0 },
+			{ -1, "ab", 0.5 }, { 0, "a", 2.0 }, { 0, "a", 2.5 }, { 7, "", -0.5 } };
+		for (std::size_t i = 1; i < std::size(keys); i++) {
+			if (!(normalize_key(keys[i - 1]) < normalize_key(keys[i])))
+				return false;
+		}
+
+		// Small fixed-width keys become integers
+		static_assert(std::is_same_v<normalized_key_t<std::tuple<std::int16_t, bool, std::uint32_t>>, std::uint64_t>);
+		return normalize_key(std::pair<std::int16_t, bool>{ -1, true }) < normalize_key(std::pair<std::int16_t, bool>{ 0, false })
+			&& normalize_key(std::int8_t{ -128 }) == 0 && normalize_key(-1.5f) < normalize_key(-1.25f);
+		}(), "Normalized keys");
+
+	RUNTIME_UNITTEST([] {
+		using row = std::tuple<int, std::string, double>;
+		power_normalized_list<row> list(std::vector<normalized<row>>{ row{ 1, "a", 2.0 }, row{ 1, "a", 3.0 }, row{ 1, "b", -1.0 }, row{ 2, "", 0.0 } });
+		list.insert(row{ 1, "a", 2.5 });
+		list.remove(normalize_key(row{ 1, "b", -1.0 }));
+		std::vector<row> rows;
+		for (auto const& entry : list)
+			rows.push_back(entry.value);
+		return list.contains(normalize_key(row{ 1, "a", 2.5 })) && !list.contains(normalize_key(row{ 1, "a", 2.25 }))
+			&& rows == std::vector<row>{ { 1, "a", 2.0 }, { 1, "a", 2.5 }, { 1, "a", 3.0 }, { 2, "", 0.0 } };
+		}(), "Normalized key list");
+
+	UNITTEST([] {
+		using uuid = byte_key<16>;
+		auto const make = [](unsigned char first, unsigned char last) {
+			uuid id{};
+			id.front() = std::byte{ first };
+			id.back() = std::byte{ last };
+			return id;
+		};
+		power_list<uuid> ids(std::vector{ make(0, 0), make(0, 1), make(0, 0xff), make(0x80, 0), make(0xff, 0xff) });
+		return make(0, 0xff) < make(0x80, 0) && make(0, 1) != make(0, 2) && ids.contains(make(0x80, 0)) && !ids.contains(make(0x80, 1));
+		}(), "Byte keys");
+
+	RUNTIME_UNITTEST([] {
+		// The vector and word compares agree with comparing byte by byte
+		bool passed = true;
+		auto const check = [&]<std::size_t N>(byte_key<N> const& a, byte_key<N> const& b) {
+			passed &= (a <=> b) == std::lexicographical_compare_three_way(a.begin(), a.end(), b.begin(), b.end());
+			passed &= (a == b) == std::ranges::equal(a, b);
+		};
+		auto const test = [&]<std::size_t N>(byte_key<N>) {
+			byte_key<N> a{}, b{};
+			check(a, b);
+			for (std::size_t i = 0; i < N; i++) {
+				for (unsigned char v : { 0x01, 0x7f, 0x80, 0xff }) {
+					b = a;
+					b[i] = std::byte{ v };
+					check(a, b);
+					check(b, a);
+				}
+			}
+		};
+		test(byte_key<16>{});
+		test(byte_key<20>{});
+		test(byte_key<32>{});
+		test(byte_key<64>{});
+
+		power_list<byte_key<32>> digests;
+		for (unsigned char i = 0; i < 200; i++) {
+			byte_key<32> digest{};
+			digest[31 - i % 32] = std::byte{ i };
+			digests.insert(digest);
+		}
+		digests.rebalance();
+		byte_key<32> probe{};
+		probe[27] = std::byte{ 164 };
+		return passed && digests.contains(probe) && std::ranges::is_sorted(digests);
+		}(), "Byte key compares");
+
+	UNITTEST([] {
+		power_string_list<> list(std::vector<std::string_view>{ "apple", "banana", "cherry" });
+		list.insert("apricot");
+		list.insert(std::string_view("a longer string that would not fit in a std::string without a heap allocation"));
+		list.remove("banana");
+		list.remove("cherry");
+		if (!list.contains("apricot") || list.contains("banana") || list.size() != 3 || std::ranges::distance(list.prefix_range("ap")) != 2)
+			return false;
+
+		// The removed strings are more than half of the arena, so rebalancing compacts it
+		std::size_t const before = list.arena_size();
+		list.remove("a longer string that would not fit in a std::string without a heap allocation");
+		list.rebalance();
+		std::vector<std::string_view> strings;
+		for (arena_string str : list)
+			strings.push_back(str.view());
+		if (list.arena_size() != 12 || before <= 90 || strings != std::vector<std::string_view>{ "apple", "apricot" })
+			return false;
+
+		// Empty strings take no room in the arena
+		power_string_list<> empty;
+		empty.insert("");
+		empty.insert("a");
+		empty.insert("");
+		return empty.size() == 3 && empty.contains("") && empty.begin()->view().empty() && empty.arena_size() == 1;
+		}(), "Arena strings");
+
+	UNITTEST([] {
+		constexpr power_list_options indexed{ .hash_index = true };
+		constexpr power_list_options indexed_deferred{ .deferred_erase = true, .hash_index = true };
+
+		power_list<int, std::identity{}, indexed> list(std::views::iota(0, 100) | std::views::transform([](int i) { return i * 2; }));
+		list.insert(7);
+		list.insert(7);
+		list.erase(list.find(7));
+		list.remove(0);
+		list.remove(198);
+		list.rebalance(relocate);
+		if (!list.contains(7) || list.contains(0) || list.contains(198) || !list.contains(100) || list.contains(101) || list.size() != 99)
+			return false;
+		list.erase(list.find(7));
+		auto const both = set_union(list, power_list<int, std::identity{}, indexed>(std::vector{ 1, 3 }));
+
+		power_list<int, std::identity{}, indexed_deferred> deferred(std::vector{ 1, 2, 3, 4, 5, 6, 7, 8 });
+		deferred.remove(2);
+		bool const hidden = !deferred.contains(2);
+		deferred.insert(2);
+		for (int i : { 1, 3, 4 })
+			deferred.remove(i);
+		return !list.contains(7) && both.contains(3) && both.contains(196) && hidden && deferred.contains(2) && !deferred.contains(4) && deferred.find(8) && deferred.size() == 5;
+		}(), "Hash index");
+
+	UNITTEST([] {
+		power_list<int, std::identity{}, power_list_options{ .hash_index = true }> list(std::vector{ 1, 5, 5, 5, 9 });
+		list.erase(std::next(list.lower_bound(5)));
+		if (!list.contains(5) || list.size() != 4)
+			return false;
+		list.remove(5);
+		if (!list.contains(5))
+			return false;
+		list.remove(5);
+		return !list.contains(5) && list.contains(1) && list.contains(9) && list.size() == 2;
+		}(), "Hash index with a middle duplicate erased");
+
+	RUNTIME_UNITTEST([] {
+		int compares = 0;
+		struct counted_key {
+			int value;
+			int* compares;
+			constexpr bool operator==(counted_key const& other) const {
+				*compares += 1;
+				return value == other.value;
+			}
+			constexpr std::strong_ordering operator<=>(counted_key const& other) const {
+				*compares += 1;
+				return value <=> other.value;
+			}
+		};
+
+		std::vector<counted_key> keys;
+		for (int i = 0; i < 256; i++)
+			keys.push_back({ i, &compares });
+		power_list<counted_key, std::identity{}, power_list_options{ .access_counts = true, .access_sample_rate = 1 }> list(keys);
+		auto const compares_to_find = [&](int value) {
+			compares = 0;
+			bool const found = list.contains({ value, &compares });
+			return found ? compares : -1;
+		};
+
+		// Rebalancing without counts gives every key about log2(n) steps
+		list.insert({ -1, &compares });
+		list.remove({ -1, &compares });
+		list.rebalance();
+		int const before = compares_to_find(200);
+		for (int i = 0; i < 100; i++)
+			(void)list.contains({ 200, &compares });
+		list.rebalance();
+		int const after = compares_to_find(200);
+
+		// A few lookups are not enough for a new layout
+		int const cold = compares_to_find(10);
+		for (int i = 0; i < 10; i++)
+			(void)list.contains({ 10, &compares });
+		list.rebalance();
+		if (compares_to_find(10) != cold)
+			return false;
+
+		for (int i = 0; i < 256; i++) {
+			if (compares_to_find(i) < 0 || compares_to_find(i) > 2 * before)
+				return false;
+		}
+		return after < before && std::ranges::is_sorted(list);
+		}(), "Access counts");
+
+	RUNTIME_UNITTEST([] {
+		auto const path = std::filesystem::temp_directory_path() / "power_kv_store_unittest.dat";
+		std::filesystem::remove(path);
+		{
+			power_kv_store store(path);
+			for (int i = 0; i < 100; i++)
+				store.put("key" + std::to_string(i), std::to_string(i));
+			store.put("key5", "five");
+			if (!store.remove("key6") || store.remove("key6") || store.get("key6") || store.get("key5") != "five")
+				return false;
+
+			std::string seen;
+			store.scan("key4", "key51", [&](std::string_view k, std::string_view v) { seen.append(k).append("=").append(v).append(" "); });
+			if (!seen.starts_with("key4=4 key40=40 ") || !seen.ends_with("key5=five key50=50 key51=51 ") || std::ranges::count(seen, '=') != 14)
+				return false;
+
+			auto const before = std::filesystem::file_size(path);
+			store.compact();
+			if (std::filesystem::file_size(path) >= before || store.get("key5") != "five" || store.size() != 99)
+				return false;
+			store.put("key6", "six");
+		}
+
+		// A record cut short by a crash is dropped when the store is opened again
+		std::ofstream(path, std::ios::binary | std::ios::app).write("\x04\x00", 2);
+		power_kv_store store(path);
+		bool const passed = store.size() == 100 && store.get("key5") == "five" && store.get("key6") == "six" && store.get("key99") == "99";
+		return passed;
+		}(), "Key-value store");
+
+	RUNTIME_UNITTEST([] {
+		auto const path = std::filesystem::temp_directory_path() / "power_kv_store_failing_unittest.dat";
+		std::filesystem::path const blocked = path.string() + ".compact";
+		std::filesystem::remove(path);
+		std::filesystem::remove_all(blocked);
+
+		// A directory where the compacted file goes makes every compaction fail
+		std::filesystem::create_directory(blocked);
+		power_kv_store store(path);
+		std::string last;
+		bool thrown = false;
+		for (int i = 0; i < 20; i++) {
+			try {
+				std::string const value = std::to_string(i);
+				store.put("key", value);
+				last = value;
+			}
+			catch (std::exception const&) {
+				thrown = true;
+			}
+		}
+		for (int i = 0; i < 1000 && !thrown; i++) {
+			try {
+				(void)store.size();
+				std::this_thread::sleep_for(std::chrono::milliseconds(1));
+			}
+			catch (std::exception const&) {
+				thrown = true;
+			}
+		}
+
+		// The old file is still in use, and compacts once the directory is gone
+		std::filesystem::remove(blocked);
+		auto const before = std::filesystem::file_size(path);
+		try {
+			store.compact();
+		}
+		catch (std::exception const&) { // a background compaction failed just before
+			store.compact();
+		}
+		bool const passed = thrown && store.get("key") == last && store.size() == 1 && std::filesystem::file_size(path) < before;
+		return passed;
+		}(), "Key-value store keeps its file when compaction fails");
+
 	return 0;
 }
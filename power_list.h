@@ -2,99 +2,185 @@
 #define POWER_LIST_H
 
 #include "scatter_allocator.h"
+#include "balance_helper.h"
+#include "hash_index.h"
 #include <cassert>
 #include <span>
 #include <iterator>
 #include <bit>
 #include <algorithm>
+#include <utility>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <vector>
+#include <string_view>
 #include <ranges> // only for std::ranges::sized_range -_-
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#include <xmmintrin.h>
+#endif
 
 namespace kg {
-	template <typename T>
-	class power_list {
-		struct node {
-			node* next[2];
-			T data;
+	// Optional features of a power_list. Features that are turned off cost nothing.
+	struct power_list_options {
+		// 'erase' only marks nodes as dead. Lookups and iteration skip dead nodes,
+		// and they are unlinked and freed in one sweep when more than
+		// 'max_dead_percent' of the nodes are dead, or when 'purge' is called.
+		bool deferred_erase = false;
+		std::uint8_t max_dead_percent = 25;
+
+		// Keeps an order-independent hash of the elements up to date, so lists with
+		// different elements are told apart in O(1), and 'hash' is O(1).
+		// The elements must be integers, or have a 'std::hash' specialization.
+		bool fingerprint = false;
+
+		// Every node carries the sum of the element hashes from it up to its skip link,
+		// which is the node and the subtree before the link, so the hash of the elements
+		// in any key range takes one search. 'diff' uses it to find the differences
+		// between two lists without comparing the ranges they agree on.
+		// Skip links do not cross, so the sums that an insert or erase changes are all
+		// on the search path for its key, and they are kept up to date on the way. The
+		// sums belong to the layout, so iterating does not rebalance the list.
+		// The elements must be hashable, like for 'fingerprint'.
+		bool merkle = false;
+
+		// Elements can be inserted with a deadline. 'find', 'contains' and 'lower_bound'
+		// that are given the current time treat elements that are past their deadline as
+		// absent. Everything else, like iteration and 'size', sees them until 'reap' is
+		// called with a time at or past their deadline, which erases them.
+		// Expired nodes are reclaimed like erased ones, so it needs 'deferred_erase'.
+		// Copies of a list do not carry the deadlines over.
+		bool ttl = false;
+
+		// Every node keeps the first 8 bytes of its key next to the links, so most
+		// comparisons in a search are settled without touching the key's own buffer.
+		// The key must convert to 'std::string_view'.
+		bool key_prefix = false;
+
+		// Keeps a hash table from keys to nodes next to the list, so 'find' and
+		// 'contains' take O(1) instead of a search. Ordered operations still search
+		// the list. It costs about 32 bytes per element, and a rebuild of the table
+		// whenever the nodes are freed in bulk or moved.
+		// The keys must be integers, or have a 'std::hash' specialization.
+		bool hash_index = false;
+
+		// Lookups count how often each key is found, for one in 'access_sample_rate'
+		// of them, and 'rebalance' lays out the skip links so that keys that are found
+		// more often take fewer steps to reach, and the rest about log2(n) steps.
+		// The counts are halved by every new layout, so the layout follows the workload.
+		// Without changes to the list, 'rebalance' only lays the list out anew once the
+		// sampled lookups since the last layout reach a quarter of the element count.
+		// Lookups write to the list, so they must not run concurrently.
+		bool access_counts = false;
+		std::uint8_t access_sample_rate = 16;
+	};
+
+	// Selects the relocating overload of 'rebalance'
+	struct relocate_t {
+		explicit relocate_t() = default;
+	};
+	inline constexpr relocate_t relocate{};
+
+	namespace detail {
+		// Stands in for node and list members of features that are turned off
+		struct empty_field {};
+
+		// The list side of 'power_list_options::access_counts'
+		struct access_sampler {
+			std::uint32_t countdown = 1; // lookups until the next one is counted
+			std::size_t samples = 0;     // counted since the last rebalance
 		};
 
-		struct balance_helper {
-			struct stepper {
-				std::size_t target;
-				std::size_t size;
-				node* from;
-				constexpr bool operator<(stepper const& r) const {
-					return (r.target < target);
-				}
-				constexpr auto operator<=>(stepper const&) const = default;
-			};
+		// The node augmentation of 'power_list_options::merkle', for the nodes from
+		// a node up to its skip link. The tail links to itself, and holds just itself.
+		struct merkle_sum {
+			std::uint64_t hashes; // sum of the hashes of the live elements
+			std::size_t nodes;    // dead ones included
 
-			node* curr{};
-			std::size_t count{};
-			std::size_t log_n{};
-			std::size_t index{ 0 };
-			stepper* steppers{};
-
-			constexpr balance_helper(balance_helper const& other)
-				: curr(other.curr), count(other.count), log_n(other.log_n), steppers(new stepper[log_n]) {
-				// Copy steppers
-				for (std::size_t i = 0; i < log_n; i++) {
-					steppers[i] = other.steppers[i];
-				}
+			constexpr merkle_sum& operator+=(merkle_sum const& other) {
+				hashes += other.hashes;
+				nodes += other.nodes;
+				return *this;
 			}
-			constexpr balance_helper(node* const n, std::size_t count) : curr(n), count(count), log_n(std::bit_width(count - 1)), steppers(new stepper[log_n]) {
-				// Set up steppers
-				node* current = n;
-				for (std::size_t i = 0, step = count; current != nullptr && i < log_n; i++, step >>= 1) {
-					steppers[log_n - 1 - i] = { i + step, step, current };
-					current = current->next[0];
-				}
+			constexpr merkle_sum& operator-=(merkle_sum const& other) {
+				hashes -= other.hashes;
+				nodes -= other.nodes;
+				return *this;
 			}
-			constexpr ~balance_helper() {
-				while (*this)
-					balance_current_and_advance();
-
-				// TODO! Instead of just pointing to the last element, which
-				//       will make deletions harder, drop them down a power,
-				//       eg. 32 drops to 16+1
-				for (std::size_t i = 0; i < log_n; i++)
-					steppers[i].from->next[1] = curr;
-				delete[] steppers;
-			}
-			constexpr void balance_current_and_advance() {
-				assert(*this && "Called while invalid");
-
-				std::span<stepper> heap(steppers, steppers + log_n);
-				while (heap.front().target == index) {
-					heap.front().from->next[1] = curr->next[0];
-					heap.front().from = curr;
-					heap.front().target += heap.front().size;
-					drop_front_in_heap(heap);
-				}
-
-				curr = curr->next[0];
-				index += 1;
+			friend constexpr merkle_sum operator-(merkle_sum a, merkle_sum const& b) {
+				return a -= b;
 			}
-			constexpr operator bool() const {
-				return nullptr != curr->next[0];
+		};
+
+		// Scrambles the bits of a hash, so the sum of many hashes stays well mixed
+		constexpr std::uint64_t mix64(std::uint64_t x) {
+			x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ull;
+			x = (x ^ (x >> 27)) * 0x94d049bb133111ebull;
+			return x ^ (x >> 31);
+		}
+
+		// 'mix64' maps 0 to 0, which would leave the sums the same with or without
+		// the element, so the value is offset first, like splitmix64 does
+		template <typename T>
+		constexpr std::uint64_t element_hash(T const& val) {
+			constexpr std::uint64_t offset = 0x9e3779b97f4a7c15ull;
+			if constexpr (std::is_integral_v<T>)
+				return mix64(static_cast<std::uint64_t>(val) + offset);
+			else
+				return mix64(std::hash<T>{}(val) + offset);
+		}
+
+		struct list_algorithms;
+
+		// Asks for the cache line at 'p' to be loaded. Does nothing at compile time.
+		constexpr void prefetch([[maybe_unused]] void const* p) {
+			if !consteval {
+#if defined(__GNUC__) || defined(__clang__)
+				__builtin_prefetch(p);
+#elif defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+				_mm_prefetch(static_cast<char const*>(p), _MM_HINT_T0);
+#endif
 			}
+		}
+	}
 
-		private:
-			// Drops the front stepper down the heap until the heap property is restored
-			constexpr static void drop_front_in_heap(std::span<stepper> heap) {
-				std::size_t index = 0;
-				do {
-					std::size_t const max = 2 * index + (heap[2 * index] > heap[2 * index + 1]);
-					if (heap[index] > heap[max]) {
-						std::swap<stepper>(heap[index], heap[max]);
-						index = max;
-					}
-					else {
-						break;
-					}
-				} while (2 * index + 1 < heap.size());
+	// 'Projection' maps an element to the key it is ordered and searched by,
+	// eg. 'power_list<order, &order::id>'. By default the element is its own key.
+	template <typename T, auto Projection = std::identity{}, power_list_options Options = {}>
+	class power_list {
+		friend struct detail::list_algorithms;
+
+	public:
+		using key_type = std::remove_cvref_t<std::invoke_result_t<decltype(Projection) const&, T const&>>;
+
+	private:
+		struct node {
+			node* next[2];
+			T data;
+			[[no_unique_address]] std::conditional_t<Options.deferred_erase, bool, detail::empty_field> dead{};
+			[[no_unique_address]] std::conditional_t<Options.access_counts, std::uint32_t, detail::empty_field> hits{}; // sampled lookups that found it
+			[[no_unique_address]] std::conditional_t<Options.merkle, detail::merkle_sum, detail::empty_field> merkle{};
+			[[no_unique_address]] std::conditional_t<Options.ttl, std::uint64_t, detail::empty_field> expires_at{}; // 0 never expires
+			[[no_unique_address]] std::conditional_t<Options.key_prefix, std::uint64_t, detail::empty_field> prefix = prefix_of(key());
+
+			constexpr decltype(auto) key() const {
+				return std::invoke(Projection, data);
 			}
 		};
 
+		using balance_helper = detail::balance_helper<node>;
+
+		static_assert(!Options.key_prefix || std::convertible_to<key_type const&, std::string_view>, "'key_prefix' needs keys that convert to 'std::string_view'");
+		static_assert(!Options.ttl || Options.deferred_erase, "'ttl' reclaims expired nodes through 'deferred_erase'");
+		static_assert(!Options.access_counts || Options.access_sample_rate > 0, "'access_sample_rate' must be at least 1");
+
+		// A pending expiry. It is stale if the node was revived with another deadline.
+		// They are kept in a heap with the earliest deadline at the front.
+		struct deadline {
+			std::uint64_t at;
+			node* n;
+		};
+
 	public:
 		struct iterator {
 			friend class power_list;
@@ -107,10 +193,10 @@ namespace kg {
 			using iterator_category = std::forward_iterator_tag;
 
 			constexpr iterator() noexcept = default;
+			// Only the original iterator drives a rebalance, copies just walk the list
 			constexpr iterator(iterator const& other) noexcept {
 				curr = other.curr;
 				prev = other.prev;
-				helper = other.helper ? new balance_helper(other.helper->curr, other.helper->count) : nullptr;
 			}
 			constexpr iterator(iterator&& other) noexcept : curr(other.curr), prev(other.prev), helper(std::exchange(other.helper, nullptr)) {}
 			constexpr iterator(node* const n, std::size_t count) : curr(n) {
@@ -125,7 +211,8 @@ namespace kg {
 			constexpr iterator& operator=(iterator const& other) {
 				curr = other.curr;
 				prev = other.prev;
-				helper = other.helper ? new balance_helper(other.helper->curr, other.helper->count) : nullptr;
+				delete helper;
+				helper = nullptr;
 				return *this;
 			}
 
@@ -142,15 +229,17 @@ namespace kg {
 					return std::strong_ordering::less;
 				if (!curr && other.curr)
 					return std::strong_ordering::greater;
-				return curr->data <=> other.curr->data;
+				return curr->key() <=> other.curr->key();
 			}
 
 			constexpr iterator& operator++() {
 				assert(curr != nullptr && "Trying to step past end of list");
-				if (helper && *helper)
-					helper->balance_current_and_advance();
-				prev = curr;
-				curr = curr->next[0];
+				do {
+					if (helper && *helper)
+						helper->balance_current_and_advance();
+					prev = curr;
+					curr = curr->next[0];
+				} while (curr && is_dead(curr));
 				return *this;
 			}
 
@@ -193,6 +282,100 @@ namespace kg {
 		};
 		using const_iterator = iterator;
 
+		// Walks the list with a ring of the next 'Distance' nodes, and prefetches
+		// each node as it enters the ring, along with the target of its skip link.
+		// Following 'next[0]' is a chain of dependent loads, but skip links give the
+		// addresses of nodes further ahead for free, so several loads are in flight
+		// at once, even when the nodes are scattered across memory.
+		template <std::size_t Distance>
+		struct prefetching_iterator {
+			static_assert(std::has_single_bit(Distance), "Distance must be a power of two");
+
+			// iterator traits
+			using difference_type = ptrdiff_t;
+			using value_type = T;
+			using pointer = const T*;
+			using reference = const T&;
+			using iterator_category = std::forward_iterator_tag;
+
+			constexpr prefetching_iterator() noexcept = default;
+			constexpr prefetching_iterator(node* n) noexcept {
+				for (node*& slot : ring) {
+					slot = n;
+					if (n) {
+						detail::prefetch(n);
+						lead = n;
+						n = n->next[0];
+					}
+				}
+				skip_dead();
+			}
+
+			constexpr prefetching_iterator& operator++() {
+				assert(ring[pos] != nullptr && "Trying to step past end of list");
+				advance();
+				skip_dead();
+				return *this;
+			}
+
+			constexpr prefetching_iterator operator++(int) {
+				prefetching_iterator const retval = *this;
+				++(*this);
+				return retval;
+			}
+
+			constexpr bool operator==(std::default_sentinel_t) const {
+				return ring[pos] == nullptr;
+			}
+
+			constexpr bool operator==(prefetching_iterator const& other) const {
+				return ring[pos] == other.ring[other.pos];
+			}
+
+			constexpr reference operator*() const {
+				assert(ring[pos] != nullptr && "Dereferencing null");
+				return ring[pos]->data;
+			}
+
+			constexpr pointer operator->() const {
+				assert(ring[pos] != nullptr && "Dereferencing null");
+				return &ring[pos]->data;
+			}
+
+		private:
+			// The current node leaves the ring, and the node after the lead takes its slot
+			constexpr void advance() {
+				lead = lead ? lead->next[0] : nullptr;
+				ring[pos] = lead;
+				if (lead) {
+					detail::prefetch(lead);
+					detail::prefetch(lead->next[1]);
+				}
+				pos = (pos + 1) % Distance;
+			}
+
+			constexpr void skip_dead() {
+				while (ring[pos] && is_dead(ring[pos]))
+					advance();
+			}
+
+			node* ring[Distance]{};
+			node* lead{};
+			std::size_t pos = 0;
+		};
+
+		template <std::size_t Distance>
+		struct prefetching_range {
+			node* head;
+
+			[[nodiscard]] constexpr prefetching_iterator<Distance> begin() const {
+				return { head };
+			}
+			[[nodiscard]] constexpr std::default_sentinel_t end() const {
+				return {};
+			}
+		};
+
 		constexpr power_list() = default;
 
 		constexpr power_list(power_list const& other) {
@@ -200,10 +383,15 @@ namespace kg {
 		}
 
 		constexpr power_list(power_list&& other) {
-			head = std::exchange(other.head, nullptr);
-			count = std::exchange(other.count, 0);
-			needs_rebalance = std::exchange(other.needs_rebalance, false);
-			alloc = std::move(other.alloc);
+			take(other);
+		}
+
+		constexpr power_list& operator=(power_list&& other) {
+			if (this != &other) {
+				destroy_nodes();
+				take(other);
+			}
+			return *this;
 		}
 
 		constexpr power_list(std::ranges::sized_range auto const& range) {
@@ -218,6 +406,22 @@ namespace kg {
 			if (head == pl.head)
 				return true;
 
+			if constexpr (Options.fingerprint) {
+				if (fingerprint != pl.fingerprint)
+					return false;
+			}
+
+			if constexpr (Options.deferred_erase) {
+				// Dead nodes make the layouts differ, so compare the live elements
+				if (size() != pl.size())
+					return false;
+				for (auto a = cbegin(), b = pl.cbegin(); a; ++a, ++b) {
+					if (a.curr->data != b.curr->data)
+						return false;
+				}
+				return true;
+			}
+
 			if (head == nullptr || pl.head == nullptr)
 				return false;
 
@@ -241,14 +445,15 @@ namespace kg {
 			return true;
 		}
 
+		// Iterating lays out the skip links anew, unless they carry the sums of 'merkle'
 		[[nodiscard]] constexpr iterator begin() {
-			return { head, static_cast<std::size_t>(needs_rebalance ? count : 0) };
+			return skip_dead({ head, static_cast<std::size_t>(needs_rebalance && !Options.merkle ? count : 0) });
 		}
 		[[nodiscard]] constexpr iterator begin() const {
-			return { head, static_cast<std::size_t>(needs_rebalance ? count : 0) };
+			return skip_dead({ head, static_cast<std::size_t>(needs_rebalance && !Options.merkle ? count : 0) });
 		}
 		[[nodiscard]] constexpr const_iterator cbegin() const {
-			return { head, std::size_t{0} };
+			return skip_dead({ head, std::size_t{0} });
 		}
 
 		[[nodiscard]] constexpr std::default_sentinel_t end() {
@@ -261,22 +466,45 @@ namespace kg {
 			return {};
 		}
 
+		// Iterates the elements with prefetching, for scans over lists whose
+		// nodes are scattered in memory. It does not rebalance the list.
+		//
+		//   for (auto const& v : list.prefetched())
+		template <std::size_t Distance = 8>
+		[[nodiscard]] constexpr prefetching_range<Distance> prefetched() const {
+			return { head };
+		}
+
 		[[nodiscard]] constexpr std::size_t size() const {
-			return count;
+			if constexpr (Options.deferred_erase)
+				return count - dead_count;
+			else
+				return count;
 		}
 
 		[[nodiscard]] constexpr T front() {
 			assert(!empty() && "Can not call 'front()' on an empty list");
-			return head->data;
+			node* n = head;
+			while (is_dead(n))
+				n = n->next[0];
+			return n->data;
 		}
 
 		[[nodiscard]] constexpr T back() {
 			assert(!empty() && "Can not call 'back()' on an empty list");
-			return head->next[1] ? head->next[1]->data : head->data;
+			node* tail = head->next[1] ? head->next[1] : head;
+			if (is_dead(tail)) {
+				// There are no links backwards, so look for the last live node from the front
+				for (node* n = head; n; n = n->next[0]) {
+					if (!is_dead(n))
+						tail = n;
+				}
+			}
+			return tail->data;
 		}
 
 		[[nodiscard]] constexpr bool empty() const {
-			return nullptr == head;
+			return size() == 0;
 		}
 
 		constexpr void clear() {
@@ -285,14 +513,21 @@ namespace kg {
 			head = nullptr;
 			count = 0;
 			needs_rebalance = false;
+			dead_count = {};
+			fingerprint = {};
+			merkle_total = {};
+			deadlines = {};
+			index = {};
+			if constexpr (Options.access_counts)
+				sampler = {};
 		}
 
 		constexpr void assign_range(std::ranges::sized_range auto const& range) {
-			assert(std::ranges::is_sorted(range) && "Input range must be sorted");
+			assert(std::ranges::is_sorted(range, {}, Projection) && "Input range must be sorted");
 			if (range.empty())
 				return;
 
-			if (!empty())
+			if (head)
 				clear();
 
 			// Save the range size
@@ -321,66 +556,206 @@ namespace kg {
 				std::construct_at(&nodes[i], node{ {&nodes[i + 1], &nodes[i + 1]}, *curr++ });
 			}
 
-			// Create a rebalancing iterator
-			iterator it_rebalance{ head, count };
+			// Create a rebalancing iterator. It sets the last links as it goes out of scope.
+			{
+				iterator it_rebalance{ head, count };
 
-			// Process the rest of the range while also rebalancing
-			for (; i < (count - 1); i += 1) {
-				assert(curr != end && "iterator/size mismatch");
-				std::construct_at(&nodes[i], node{ {&nodes[i + 1], &nodes[i + 1]}, *curr++ });
-				++it_rebalance;
-			}
+				// Process the rest of the range while also rebalancing
+				for (; i < (count - 1); i += 1) {
+					assert(curr != end && "iterator/size mismatch");
+					std::construct_at(&nodes[i], node{ {&nodes[i + 1], &nodes[i + 1]}, *curr++ });
+					++it_rebalance;
+				}
 
-			// Finally set up the tail node
-			std::construct_at(&nodes[i], node{ {nullptr, &nodes[i]}, *curr++ });
+				// Finally set up the tail node
+				std::construct_at(&nodes[i], node{ {nullptr, &nodes[i]}, *curr++ });
+			}
 
 			// Sanity checks
 			assert(curr == end && "Iterator should be at the end here");
+
+			recompute_fingerprint();
+			refresh_merkle();
+			rebuild_index();
 		}
 
 		constexpr void insert(T val) {
-			node* n = alloc.allocate_one();
-			std::construct_at(n, node{ {nullptr, nullptr}, val });
+			insert_node(std::move(val));
+		}
+
+		// Inserts an element that expires at 'expires_at', in the same units 'reap' is called with
+		constexpr void insert(T val, std::uint64_t expires_at) requires (Options.ttl) {
+			assert(expires_at != 0 && "A deadline of 0 means the element never expires");
+			node* n = insert_node(std::move(val));
+			n->expires_at = expires_at;
+			deadlines.push_back({ expires_at, n });
+			std::ranges::push_heap(deadlines, std::greater{}, &deadline::at);
+		}
+
+		// Marks the elements whose deadline is at or before 'now' as dead, and returns how many expired.
+		// It is O(1) when nothing has expired, and otherwise O(k log n) for k expired elements. The dead
+		// nodes are freed in one sweep with a single rebalance when they make up 'max_dead_percent' of
+		// the list, so the sweep is paid for by the expiries that led up to it.
+		constexpr std::size_t reap(std::uint64_t now) requires (Options.ttl) {
+			std::size_t expired = 0;
+			while (!deadlines.empty() && deadlines.front().at <= now) {
+				deadline const d = deadlines.front();
+				std::ranges::pop_heap(deadlines, std::greater{}, &deadline::at);
+				deadlines.pop_back();
+
+				if (!d.n->dead && d.n->expires_at == d.at) {
+					mark_dead(d.n);
+					expired += 1;
+				}
+			}
+
+			if (expired > 0 && dead_count * 100 > count * Options.max_dead_percent)
+				purge();
+			return expired;
+		}
+
+	private:
+		// Inserts 'val' and returns its node
+		constexpr node* insert_node(T val) {
+			if constexpr (Options.deferred_erase) {
+				// Bring a dead node with the same key back to life instead of allocating a new one
+				if (head) {
+					decltype(auto) key = std::invoke(Projection, val);
+					iterator it = lower_bound_node(key);
+					if (it && it.curr->dead && it.curr->key() == key) {
+						fingerprint_add(val);
+						it.curr->data = std::move(val);
+						it.curr->dead = false;
+						if constexpr (Options.ttl)
+							it.curr->expires_at = 0;
+						if constexpr (Options.access_counts)
+							it.curr->hits = 0;
+						dead_count -= 1;
+						if constexpr (Options.merkle)
+							merkle_add(it.curr, { merkle_of(it.curr).hashes, 0 });
+						return it.curr;
+					}
+				}
+			}
+
+			// Find the neighbours of the new node
+			decltype(auto) key = std::invoke(Projection, val);
+			node* prev = nullptr;
+			node* next = head;
+			if (head && head->key() < key) {
+				if (node* last = head->next[1]; last->key() < key) {
+					prev = last;
+					next = nullptr;
+				}
+				else {
+					iterator it = lower_bound_node(key);
+					prev = it.prev;
+					next = it.curr;
+				}
+			}
+
+			node* const n = alloc.allocate_one();
+			std::construct_at(n, node{ {nullptr, nullptr}, std::move(val) });
+			fingerprint_add(n->data);
+
+			// It goes in front of any equal keys, so it becomes the one the index finds
+			if constexpr (Options.hash_index)
+				index.assign(key_hash(n->key()), n, key_matches(n->key()));
 
 			if (head == nullptr) { // empty
 				head = n;
 				head->next[1] = n;
 			}
-			else if (val < head->data) { // before head
+			else if (prev == nullptr) { // before head
 				n->next[0] = head;
 				n->next[1] = head->next[1];
 				head = n;
 			}
-			else if (node* last = head->next[1]; last && (last->data < val)) { // after tail
-				last->next[0] = n;
-				last->next[1] = n;
+			else if (next == nullptr) { // after tail
+				prev->next[0] = n;
+				prev->next[1] = n;
 				head->next[1] = n;
+				n->next[1] = n;
 			}
 			else { // middle
-				iterator it = lower_bound(val);
-				it.prev->next[0] = n;
-				n->next[0] = it.curr;
-				n->next[1] = it.curr->next[1];
+				// A copy of the skip link of 'next' could cross the links to 'next'
+				prev->next[0] = n;
+				n->next[0] = next;
+				n->next[1] = next;
 			}
 
 			count += 1;
 			needs_rebalance = true;
+
+			// A new head or tail changes the span of the head, which links to the tail
+			if constexpr (Options.merkle) {
+				merkle_add(n, merkle_of(n));
+				head->merkle = head_span();
+			}
+			return n;
 		}
 
+	public:
 		// TODO
 		constexpr void insert_after(iterator, T);
 
-		constexpr void remove(T val) {
-			erase(find(val));
+		constexpr void remove(key_type const& key) {
+			erase(find(key));
 		}
 
 		constexpr void erase(iterator it) {
 			if (!it)
 				return;
 
+			if constexpr (Options.deferred_erase) {
+				if (!it.curr->dead) {
+					mark_dead(it.curr);
+					if (dead_count * 100 > count * Options.max_dead_percent)
+						purge();
+				}
+				return;
+			}
+
 			node* n = it.curr;
 			node* next = n->next[0];
-			if (it.prev == nullptr) { // head
+
+			// The links to 'n' move to the node after it, and their spans stay the same
+			if constexpr (Options.merkle)
+				merkle_subtract(n, merkle_of(n));
+
+			// Skip links do not cross, so the nodes linking to 'n' are on the search
+			// path for its key, and the node before it ends that path. Iterators from
+			// the hash index do not know that node either.
+			node* prev = nullptr;
+			for_path_to(n, [&](node* p) {
+				if (next && p->next[1] == n)
+					p->next[1] = next;
+				prev = p;
+			});
+			if (!next) {
+				for_path_to(n, [&](node* p) {
+					if (p->next[1] == n) {
+						p->next[1] = prev;
+						if constexpr (Options.merkle) {
+							if (p != prev)
+								p->merkle -= merkle_of(prev);
+						}
+					}
+				});
+			}
+
+			// The index holds the first node of equal keys, so only erasing that one changes it
+			if constexpr (Options.hash_index) {
+				std::uint64_t const hash = key_hash(n->key());
+				if (index.find(hash, key_matches(n->key())) == n) {
+					if (next && next->key() == n->key())
+						index.assign(hash, next, key_matches(n->key()));
+					else
+						index.erase(hash, n);
+				}
+			}
+
+			if (prev == nullptr) { // head
 				if (next != nullptr) {
 					node* tail = n->next[1];
 					next->next[1] = tail;
@@ -389,38 +764,196 @@ namespace kg {
 			}
 			else {
 				if (next == nullptr) // tail
-					head->next[1] = it.prev;
-				it.prev->next[0] = next;
+					head->next[1] = prev;
+				prev->next[0] = next;
 			}
 
+			fingerprint_remove(n->data);
 			std::destroy_at(n);
 			alloc.deallocate({ n, 1 });
 			count -= 1;
 			needs_rebalance = true;
+			if constexpr (Options.merkle) {
+				if (head)
+					head->merkle = head_span();
+			}
 		}
 
 		constexpr void rebalance() {
+			if constexpr (Options.access_counts) {
+				// A new layout takes O(n), so the counts alone only ask for one once there
+				// have been sampled lookups for a quarter of the elements since the last one
+				if (head && (needs_rebalance || sampler.samples * 4 >= count)) {
+					balance_by_access();
+					refresh_merkle();
+					needs_rebalance = false;
+				}
+				return;
+			}
+
 			if (head && needs_rebalance) {
-				balance_helper bh(head, count);
-				while (bh)
-					bh.balance_current_and_advance();
+				// The helper sets the last links as it goes out of scope
+				{
+					balance_helper bh(head, count);
+					while (bh)
+						bh.balance_current_and_advance();
+				}
 
+				refresh_merkle();
 				needs_rebalance = false;
 			}
 
 		}
 
-		[[nodiscard]] constexpr iterator find(T const& val) const {
-			if (head == nullptr || val < head->data || val > head->next[1]->data)
+		// Rebalances the list, and moves the elements into one new block of memory in
+		// list order, so walking the list walks memory front to back. The old pools are
+		// freed afterwards. It takes a single sweep, and the extra memory is the new
+		// block, until the old pools are freed. Dead nodes are dropped on the way.
+		constexpr void rebalance(relocate_t) {
+			std::size_t const live = size();
+			if (live == 0) {
+				clear();
+				return;
+			}
+
+			scatter_allocator<node> fresh;
+			std::span<node> nodes;
+			fresh.allocate_with_callback(live, [&](std::span<node> span) {
+				assert(span.size() == live);
+				nodes = span;
+				});
+
+			// Moves the next live element into node 'i', and destroys the old nodes it passes
+			node* old = head;
+			auto const relocate_next = [&](std::size_t i) {
+				while (is_dead(old)) {
+					node* const next = old->next[0];
+					std::destroy_at(old);
+					old = next;
+				}
+
+				node* const next = (i + 1 < live) ? &nodes[i + 1] : nullptr;
+				std::construct_at(&nodes[i], node{ {next, next ? next : &nodes[i]}, std::move(old->data) });
+				if constexpr (Options.ttl)
+					nodes[i].expires_at = old->expires_at;
+				if constexpr (Options.access_counts)
+					nodes[i].hits = old->hits;
+
+				node* const next_old = old->next[0];
+				std::destroy_at(old);
+				old = next_old;
+			};
+
+			// Like 'assign_range', the rebalancer needs 'logN' nodes before it can start
+			std::size_t const logN = (std::size_t)std::bit_width(live - 1);
+			std::size_t i = 0;
+			for (; i < logN; i += 1)
+				relocate_next(i);
+			{
+				balance_helper bh(nodes.data(), live);
+				for (; i < live; i += 1) {
+					relocate_next(i);
+					if (bh) // a single node has nothing to balance
+						bh.balance_current_and_advance();
+				}
+			}
+
+			// Dead nodes after the last live one
+			while (old) {
+				node* const next = old->next[0];
+				std::destroy_at(old);
+				old = next;
+			}
+
+			// The old pools end up in 'fresh', and are freed with it
+			alloc = std::move(fresh);
+			head = nodes.data();
+			count = live;
+			dead_count = {};
+			if constexpr (Options.access_counts)
+				balance_by_access();
+			rebuild_deadlines();
+			rebuild_index();
+			refresh_merkle();
+			needs_rebalance = false;
+		}
+
+		// Unlinks and frees all dead nodes in a single sweep, and rebalances once
+		constexpr void purge() requires (Options.deferred_erase) {
+			if (dead_count == 0)
+				return;
+
+			// Drop the deadlines of the nodes that are about to be freed
+			if constexpr (Options.ttl) {
+				std::erase_if(deadlines, [](deadline const& d) { return d.n->dead; });
+				std::ranges::make_heap(deadlines, std::greater{}, &deadline::at);
+			}
+
+			// Neighbouring dead nodes are handed back to the allocator as one block
+			std::span<node> freed;
+			auto const release = [&] {
+				if (!freed.empty())
+					alloc.deallocate(freed);
+				freed = {};
+			};
+
+			node* prev = nullptr;
+			for (node* n = head; n;) {
+				node* const next = n->next[0];
+				if (n->dead) {
+					if (prev)
+						prev->next[0] = next;
+					else
+						head = next;
+
+					std::destroy_at(n);
+					count -= 1;
+					if (!std::is_constant_evaluated() && !freed.empty() && freed.data() + freed.size() == n) {
+						freed = { freed.data(), freed.size() + 1 };
+					}
+					else {
+						release();
+						freed = { n, 1 };
+					}
+				}
+				else {
+					prev = n;
+				}
+				n = next;
+			}
+			release();
+			dead_count = 0;
+			rebuild_index();
+
+			// Rebalancing rewrites every skip link, so none are left pointing to freed nodes
+			needs_rebalance = true;
+			rebalance();
+		}
+
+		[[nodiscard]] constexpr iterator find(key_type const& val) const {
+			if constexpr (Options.hash_index) {
+				node* n = index.find(key_hash(val), key_matches(val));
+				if (n == nullptr)
+					return {};
+				while (is_dead(n) && n->next[0] && n->next[0]->key() == val)
+					n = n->next[0];
+				if (is_dead(n))
+					return {};
+				record_access(n);
+				return { n, nullptr };
+			}
+
+			probe const p(val);
+			if (head == nullptr || p.before(head) || p.after(head->next[1]))
 				return {};
 
 			node* prev = nullptr;
 			node* n = head;
-			while (n->next[0] && val > n->next[0]->data) {
+			while (n->next[0] && p.after(n->next[0])) {
 				prev = n;
-				n = n->next[val > n->next[1]->data];
+				n = n->next[p.after(n->next[1])];
 			}
-			while (n->data < val) {
+			while (p.after(n)) {
 				// The only node in the list that can have 'next[0] == nullptr' is
 				// the last node in the list. It would have been reached in the above loop.
 				assert(n->next[0] != nullptr && "This should not be possible, by design");
@@ -429,35 +962,480 @@ namespace kg {
 				n = n->next[0];
 			}
 
-			if (n->data == val)
+			// Equal keys can follow a dead node
+			while (is_dead(n) && n->next[0] && !p.before(n->next[0])) {
+				prev = n;
+				n = n->next[0];
+			}
+
+			if (p.matches(n) && !is_dead(n)) {
+				record_access(n);
 				return { n, prev };
-			else
+			}
+			else {
 				return {};
+			}
+		}
+
+		[[nodiscard]] constexpr iterator lower_bound(key_type const& val) const {
+			iterator it = skip_dead(lower_bound_node(val));
+			if (it)
+				record_access(it.curr);
+			return it;
+		}
+
+		// Lookups at time 'now'. Elements with a deadline at or before 'now' are absent,
+		// whether 'reap' has erased them yet or not.
+		[[nodiscard]] constexpr iterator find(key_type const& val, std::uint64_t now) const requires (Options.ttl) {
+			iterator it = find(val);
+
+			// Equal keys can follow an expired node
+			while (it && is_expired(it.curr, now)) {
+				++it;
+				if (!it || !(it.curr->key() == val))
+					return {};
+			}
+			return it;
+		}
+		[[nodiscard]] constexpr bool contains(key_type const& val, std::uint64_t now) const requires (Options.ttl) {
+			return find(val, now);
+		}
+		[[nodiscard]] constexpr iterator lower_bound(key_type const& val, std::uint64_t now) const requires (Options.ttl) {
+			iterator it = lower_bound(val);
+			while (it && is_expired(it.curr, now))
+				++it;
+			return it;
 		}
 
-		[[nodiscard]] constexpr iterator lower_bound(T const& val) const {
-			if (empty())
+		// Finger search. Searches on from 'hint', which must not be past 'val', so
+		// searching for keys close to the last one found is cheaper than starting over.
+		[[nodiscard]] constexpr iterator lower_bound(iterator const& hint, key_type const& val) const {
+			if (!hint)
 				return {};
-			if (val < head->data)
+			return skip_dead(partition_point_node(hint.curr, hint.prev, [&](key_type const& key) { return key < val; }));
+		}
+
+		[[nodiscard]] constexpr bool contains(key_type const& val) const {
+			return find(val);
+		}
+
+		// The elements with keys that start with 'prefix'. Both ends are found by
+		// comparing the keys against 'prefix' directly, so no strings are built.
+		[[nodiscard]] constexpr std::ranges::subrange<iterator> prefix_range(std::string_view prefix) const
+			requires std::convertible_to<key_type const&, std::string_view> {
+			return prefix_range_from(head, nullptr, prefix);
+		}
+
+		// 'prefix_range' for every prefix. Sorted prefixes are found by searching on from
+		// where the previous one started, so prefixes that are close together share most
+		// of the descent. Unsorted prefixes are visited through a sorted index.
+		[[nodiscard]] constexpr std::vector<std::ranges::subrange<iterator>> prefix_ranges(std::span<std::string_view const> prefixes) const
+			requires std::convertible_to<key_type const&, std::string_view> {
+			std::vector<std::ranges::subrange<iterator>> ranges(prefixes.size());
+			auto const resolve = [&](auto const& order) {
+				node* finger = head;
+				node* finger_prev = nullptr;
+				for (std::size_t i : order) {
+					ranges[i] = prefix_range_from(finger, finger_prev, prefixes[i]);
+					if (ranges[i].begin().curr) {
+						finger = ranges[i].begin().curr;
+						finger_prev = ranges[i].begin().prev;
+					}
+				}
+			};
+
+			if (std::ranges::is_sorted(prefixes)) {
+				resolve(std::views::iota(std::size_t{ 0 }, prefixes.size()));
+			}
+			else {
+				std::vector<std::size_t> order(prefixes.size());
+				for (std::size_t i = 0; i < order.size(); i++)
+					order[i] = i;
+				std::ranges::sort(order, [&](std::size_t a, std::size_t b) { return prefixes[a] < prefixes[b]; });
+				resolve(order);
+			}
+			return ranges;
+		}
+
+		// A hash of the elements, for using lists as keys in hash maps. It does not look at the elements.
+		[[nodiscard]] constexpr std::size_t hash() const requires (Options.fingerprint) {
+			return static_cast<std::size_t>(detail::mix64(fingerprint + size()));
+		}
+
+		// Checks membership of all the probes in one sweep of the list, and sets
+		// bit 'i' in 'mask_out' if 'probes[i]' is in the list.
+		// Unsorted probes are visited through a sorted index.
+		constexpr void contains_batch(std::span<key_type const> probes, std::span<std::uint64_t> mask_out) const {
+			assert(mask_out.size() * 64 >= probes.size() && "Mask is too small for the probes");
+			std::ranges::fill(mask_out, std::uint64_t{ 0 });
+			if (head == nullptr || probes.empty())
+				return;
+
+			if (std::ranges::is_sorted(probes)) {
+				sweep_probes(probes, mask_out, std::views::iota(std::size_t{ 0 }, probes.size()));
+			}
+			else {
+				std::vector<std::size_t> order(probes.size());
+				for (std::size_t i = 0; i < order.size(); i++)
+					order[i] = i;
+				std::ranges::sort(order, [&](std::size_t a, std::size_t b) { return probes[a] < probes[b]; });
+				sweep_probes(probes, mask_out, order);
+			}
+		}
+
+	private:
+		// The first 8 bytes of a key as a big-endian integer, zero padded, for 'key_prefix'.
+		// The integers compare like the bytes do. Keys with the same prefix may still differ after it.
+		constexpr static auto prefix_of([[maybe_unused]] key_type const& key) {
+			if constexpr (Options.key_prefix) {
+				std::string_view const bytes = key;
+				std::uint64_t prefix = 0;
+				if (!std::is_constant_evaluated() && bytes.size() >= sizeof(prefix)) {
+					std::memcpy(&prefix, bytes.data(), sizeof(prefix));
+					return std::endian::native == std::endian::little ? std::byteswap(prefix) : prefix;
+				}
+				for (std::size_t i = 0; i < sizeof(prefix); i++)
+					prefix = prefix << 8 | (i < bytes.size() ? static_cast<unsigned char>(bytes[i]) : 0u);
+				return prefix;
+			}
+			else {
+				return detail::empty_field{};
+			}
+		}
+
+		// A key to search for, and its prefix. Compares against nodes on the prefixes
+		// first, and only looks at the whole keys when the prefixes are the same.
+		struct probe {
+			key_type const& val;
+			[[no_unique_address]] decltype(prefix_of(std::declval<key_type const&>())) prefix;
+
+			constexpr explicit probe(key_type const& val) : val(val), prefix(prefix_of(val)) {}
+
+			// 'val > n->key()'
+			constexpr bool after(node const* n) const {
+				if constexpr (Options.key_prefix) {
+					if (prefix != n->prefix)
+						return prefix > n->prefix;
+				}
+				return val > n->key();
+			}
+
+			// 'val < n->key()'
+			constexpr bool before(node const* n) const {
+				if constexpr (Options.key_prefix) {
+					if (prefix != n->prefix)
+						return prefix < n->prefix;
+				}
+				return val < n->key();
+			}
+
+			// 'val == n->key()'
+			constexpr bool matches(node const* n) const {
+				if constexpr (Options.key_prefix) {
+					if (prefix != n->prefix)
+						return false;
+				}
+				return val == n->key();
+			}
+		};
+
+		// Takes the elements of 'other', and leaves it empty
+		constexpr void take(power_list& other) {
+			head = std::exchange(other.head, nullptr);
+			count = other.count;
+			needs_rebalance = other.needs_rebalance;
+			dead_count = std::exchange(other.dead_count, {});
+			fingerprint = std::exchange(other.fingerprint, {});
+			merkle_total = std::exchange(other.merkle_total, {});
+			deadlines = std::exchange(other.deadlines, {});
+			index = std::exchange(other.index, {});
+			if constexpr (Options.access_counts)
+				sampler = std::exchange(other.sampler, {});
+			alloc = std::move(other.alloc);
+			other.count = 0;
+			other.needs_rebalance = false;
+		}
+
+		// Counts one in 'access_sample_rate' lookups that found 'n'
+		constexpr void record_access([[maybe_unused]] node* n) const {
+			if constexpr (Options.access_counts) {
+				if (--sampler.countdown == 0) {
+					sampler.countdown = Options.access_sample_rate;
+					sampler.samples += 1;
+					if (n->hits != UINT32_MAX)
+						n->hits += 1;
+				}
+			}
+		}
+
+		// Lays out the skip links by the access counts, and halves them. A search for
+		// a key ends on the node before it, so that node carries the key's weight.
+		// The counts weigh as much in total as an even share for every node, so keys
+		// that are never counted stay about log2(n) steps away.
+		constexpr void balance_by_access() requires (Options.access_counts) {
+			std::uint64_t total_hits = 0;
+			for (node* n = head; n; n = n->next[0])
+				total_hits += n->hits;
+
+			std::uint64_t const share = std::max<std::uint64_t>(total_hits, 1);
+			detail::balance_by_weight<node>(head, count, [&](node const* n) {
+				return share + (n->next[0] ? n->next[0]->hits * std::uint64_t{ count } : 0);
+			});
+			for (node* n = head; n; n = n->next[0])
+				n->hits /= 2;
+			sampler.samples = 0;
+		}
+
+		// Marks a node as erased, for 'deferred_erase'
+		constexpr void mark_dead(node* n) {
+			fingerprint_remove(n->data);
+			if constexpr (Options.merkle)
+				merkle_subtract(n, { merkle_of(n).hashes, 0 });
+			n->dead = true;
+			dead_count += 1;
+		}
+
+		// For when the nodes have moved
+		constexpr void rebuild_deadlines() {
+			if constexpr (Options.ttl) {
+				deadlines.clear();
+				for (node* n = head; n; n = n->next[0]) {
+					if (n->expires_at != 0)
+						deadlines.push_back({ n->expires_at, n });
+				}
+				std::ranges::make_heap(deadlines, std::greater{}, &deadline::at);
+			}
+		}
+
+		constexpr static std::uint64_t key_hash(key_type const& key) {
+			return detail::element_hash(key);
+		}
+
+		// Tells the hash index which node has 'key'
+		constexpr static auto key_matches(key_type const& key) {
+			return [&key](node const* n) { return n->key() == key; };
+		}
+
+		// Indexes the first node of every key, for when the nodes have moved or been freed
+		constexpr void rebuild_index() {
+			if constexpr (Options.hash_index) {
+				index.clear();
+				index.reserve(count);
+				for (node* n = head; n; n = n->next[0])
+					index.emplace(key_hash(n->key()), n, key_matches(n->key()));
+			}
+		}
+
+		// Adds or removes an element from the fingerprint
+		constexpr void fingerprint_add([[maybe_unused]] T const& val) {
+			if constexpr (Options.fingerprint)
+				fingerprint += detail::element_hash(val);
+		}
+		constexpr void fingerprint_remove([[maybe_unused]] T const& val) {
+			if constexpr (Options.fingerprint)
+				fingerprint -= detail::element_hash(val);
+		}
+
+		// Recomputes the sums of all nodes from their skip links, in O(n). Rebalancing
+		// walks the whole list anyway, so this does not change what a rebalance costs.
+		constexpr void refresh_merkle() {
+			if constexpr (Options.merkle) {
+				// Every node holds the sum of the nodes before it, until its own turn
+				detail::merkle_sum sum{};
+				for (node* n = head; n; n = n->next[0]) {
+					n->merkle = sum;
+					sum += merkle_of(n);
+				}
+				merkle_total = sum.hashes;
+
+				// Skip links point ahead, so their targets still hold the sums before them
+				for (node* n = head; n; n = n->next[0]) {
+					node* const skip = n->next[1];
+					n->merkle = (skip == n) ? merkle_of(n) : skip->merkle - n->merkle;
+				}
+			}
+		}
+
+		// The sums of 'n' alone. Dead nodes count, but their elements do not.
+		constexpr static detail::merkle_sum merkle_of(node const* n) {
+			return { is_dead(n) ? 0 : detail::element_hash(n->data), 1 };
+		}
+
+		// The head links to the tail, so its span is all of the list but the tail
+		constexpr detail::merkle_sum head_span() const {
+			node* const tail = head->next[1];
+			if (tail == head)
+				return merkle_of(head);
+			return { merkle_total - merkle_of(tail).hashes, count - 1 };
+		}
+
+		// Adds 'delta' to the sums of the spans that hold 'n', and to the total, or takes it off
+		constexpr void merkle_add(node* n, detail::merkle_sum const& delta) {
+			for_spans_over(n, [&](node* p) { p->merkle += delta; });
+			merkle_total += delta.hashes;
+		}
+		constexpr void merkle_subtract(node* n, detail::merkle_sum const& delta) {
+			for_spans_over(n, [&](node* p) { p->merkle -= delta; });
+			merkle_total -= delta.hashes;
+		}
+
+		// For lists that were built without going through 'insert'
+		constexpr void recompute_fingerprint() {
+			if constexpr (Options.fingerprint) {
+				fingerprint = 0;
+				for (node* n = head; n; n = n->next[0]) {
+					if (!is_dead(n))
+						fingerprint_add(n->data);
+				}
+			}
+		}
+
+		constexpr static bool is_dead([[maybe_unused]] node const* n) {
+			if constexpr (Options.deferred_erase)
+				return n->dead;
+			else
+				return false;
+		}
+
+		constexpr static bool is_expired(node const* n, std::uint64_t now) requires (Options.ttl) {
+			return n->expires_at != 0 && n->expires_at <= now;
+		}
+
+		constexpr static iterator skip_dead(iterator it) {
+			if (it && is_dead(it.curr))
+				++it;
+			return it;
+		}
+
+		// Returns the first node not less than 'val', dead or alive
+		[[nodiscard]] constexpr iterator lower_bound_node(key_type const& val) const {
+			if (head == nullptr)
+				return {};
+			probe const p(val);
+			if (p.before(head))
 				return { head, nullptr };
+			if (p.after(head->next[1]))
+				return {};
 
 			node* prev = nullptr;
 			node* curr = head;
-			while (val > curr->data) {
+			while (p.after(curr)) {
 				prev = curr;
-				curr = curr->next[val > curr->next[1]->data];
+				curr = curr->next[p.after(curr->next[1])];
 			}
 			return { curr, prev };
 		}
 
-		constexpr bool contains(T const& val) const {
-			return find(val);
+		// Calls 'fn' with each node on the search path for the key of 'n', and then with
+		// the nodes of equal keys before it, so the last one is the node before 'n'
+		constexpr void for_path_to(node* n, auto&& fn) const {
+			auto const& key = n->key();
+			probe const p(key);
+			node* curr = head;
+			while (p.after(curr)) {
+				node* const following = curr->next[p.after(curr->next[1])];
+				fn(curr); // may move the links off 'n'
+				curr = following;
+			}
+			for (; curr != n; curr = curr->next[0])
+				fn(curr);
+		}
+
+		// Calls 'fn' with 'n' and with each node whose skip link goes past it. Those are on
+		// the search path for its key, as the links do not cross. A link to a node with an
+		// equal key goes past 'n' unless the walk to 'n' gets to that node first.
+		constexpr void for_spans_over(node* n, auto&& fn) const {
+			auto const& key = n->key();
+			probe const p(key);
+			std::vector<node*> unsure; // their links end inside one another, so the innermost is last
+			for_path_to(n, [&](node* curr) {
+				while (!unsure.empty() && unsure.back()->next[1] == curr)
+					unsure.pop_back();
+				node* const skip = curr->next[1];
+				if (skip == n)
+					return;
+				if (p.before(skip))
+					fn(curr);
+				else if (p.matches(skip))
+					unsure.push_back(curr);
+			});
+			for (node* curr : unsure)
+				fn(curr);
+			fn(n);
+		}
+
+		// Returns the first node from 'n' with a key that 'before' is false for, dead or alive.
+		// 'before' must be true for the keys up to some point in the list, and false after it,
+		// and 'n' must be the head or a node that 'before' is true for.
+		[[nodiscard]] constexpr iterator partition_point_node(node* n, node* prev, auto const& before) const {
+			if (head == nullptr || before(head->next[1]->key()))
+				return {};
+
+			while (before(n->key())) {
+				prev = n;
+				n = n->next[before(n->next[1]->key())];
+			}
+			return { n, prev };
+		}
+
+		// 'prefix_range', searching from 'n'. 'n' must be the head or a node with a key before 'prefix'.
+		[[nodiscard]] constexpr std::ranges::subrange<iterator> prefix_range_from(node* n, node* prev, std::string_view prefix) const {
+			iterator first = partition_point_node(n, prev, [&](std::string_view key) { return key < prefix; });
+			if (!first)
+				return {};
+
+			// Keys that start with 'prefix' compare equal to it on their first 'prefix.size()' characters
+			iterator last = partition_point_node(first.curr, first.prev, [&](std::string_view key) { return key.compare(0, prefix.size(), prefix) <= 0; });
+			return { skip_dead(std::move(first)), skip_dead(std::move(last)) };
+		}
+
+		// Finger search. Returns the first node from 'n' that is not less than 'val'.
+		// 'n' must not be past 'val', and 'val' must not be past the tail.
+		constexpr static node* descend(node* n, key_type const& val) {
+			probe const p(val);
+			while (n->next[0] && p.after(n->next[0]))
+				n = n->next[p.after(n->next[1])];
+			while (p.after(n))
+				n = n->next[0];
+			return n;
+		}
+
+		// Resolves the probes in the order given by 'order', which must visit them sorted.
+		// The finger only moves forward, so the list is walked at most once.
+		constexpr void sweep_probes(std::span<key_type const> probes, std::span<std::uint64_t> mask_out, auto const& order) const {
+			key_type const& tail = head->next[1]->key();
+			node* finger = head;
+
+			auto it = std::ranges::begin(order);
+			auto const end = std::ranges::end(order);
+
+			// Skip probes before the head
+			while (it != end && probes[*it] < head->key())
+				++it;
+
+			while (it != end && !(probes[*it] > tail)) {
+				finger = descend(finger, probes[*it]);
+
+				// Resolve the run of probes that lands on this node without searching again
+				do {
+					std::size_t const i = *it;
+					node* match = finger;
+					while (is_dead(match) && match->next[0] && !(probes[i] < match->next[0]->key()))
+						match = match->next[0];
+					mask_out[i / 64] |= std::uint64_t{ match->key() == probes[i] && !is_dead(match) } << (i % 64);
+					++it;
+				} while (it != end && !(finger->key() < probes[*it]));
+			}
 		}
 
-	private:
 		constexpr void destroy_nodes() {
 			node* n = head;
 			head = nullptr;
+
+			// Nodes with nothing to destroy are freed with their pools, without walking the list
+			if constexpr (std::is_trivially_destructible_v<node>)
+				return;
+
 			while (n) {
 				node* next = n->next[0];
 				assert(n != next && "Node points to itself");
@@ -469,7 +1447,25 @@ namespace kg {
 		node* head = nullptr;
 		std::size_t count : 63 = 0;
 		std::size_t needs_rebalance : 1 = false;
+		[[no_unique_address]] std::conditional_t<Options.deferred_erase, std::size_t, detail::empty_field> dead_count{};
+		[[no_unique_address]] std::conditional_t<Options.fingerprint, std::uint64_t, detail::empty_field> fingerprint{}; // sum of the element hashes
+		[[no_unique_address]] std::conditional_t<Options.merkle, std::uint64_t, detail::empty_field> merkle_total{}; // sum of the live element hashes
+		[[no_unique_address]] std::conditional_t<Options.ttl, std::vector<deadline>, detail::empty_field> deadlines{}; // min-heap of pending expiries
+		[[no_unique_address]] std::conditional_t<Options.hash_index, detail::hash_index<node>, detail::empty_field> index{}; // the first node of every key
+		[[no_unique_address]] mutable std::conditional_t<Options.access_counts, detail::access_sampler, detail::empty_field> sampler{};
 		scatter_allocator<node> alloc;
 	};
+
+	// An ordered map from 'K' to 'V', eg. 'power_map<std::string, std::uint64_t>'
+	template <typename K, typename V, power_list_options Options = {}>
+	using power_map = power_list<std::pair<K, V>, &std::pair<K, V>::first, Options>;
 }
+
+template <typename T, auto Projection, kg::power_list_options Options>
+	requires (Options.fingerprint)
+struct std::hash<kg::power_list<T, Projection, Options>> {
+	constexpr std::size_t operator()(kg::power_list<T, Projection, Options> const& list) const noexcept {
+		return list.hash();
+	}
+};
 #endif
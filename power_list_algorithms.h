@@ -0,0 +1,534 @@
+#ifndef POWER_LIST_ALGORITHMS_H
+#define POWER_LIST_ALGORITHMS_H
+
+#include "power_list.h"
+#include "intrusive_power_list.h"
+#include "parallel_helper.h"
+#include <algorithm>
+#include <bit>
+#include <cstdint>
+#include <numeric>
+#include <ranges>
+#include <span>
+#include <type_traits>
+#include <vector>
+
+namespace kg::detail {
+	// Algorithms that work on the nodes of power_lists.
+	//
+	// For the set algorithms, the result is built in two passes over the inputs, one that counts the
+	// output and one that constructs it straight into the nodes of the result.
+	// The parallel versions split the key space into ranges at keys taken from
+	// the skip links of the larger list, and run both passes range by range on
+	// all threads. Each range writes into its own slice of the result nodes,
+	// so the outputs are already concatenated when the threads are done.
+	struct list_algorithms {
+		enum class kind { intersection, union_ };
+
+		template <kind Kind, typename List>
+		constexpr static List set_operation(List const& a, List const& b) {
+			std::size_t const total = merge<Kind>(first(a), nullptr, first(b), nullptr, [](auto const*) {});
+			return build<List>(total, [&](auto nodes) {
+				std::size_t i = 0;
+				merge<Kind>(first(a), nullptr, first(b), nullptr, [&](auto const* n) {
+					construct(nodes, i++, n->data);
+				});
+			});
+		}
+
+		template <kind Kind, typename List>
+		static List set_operation_parallel(List const& a, List const& b) {
+			// Small inputs are not worth starting threads for
+			List const& larger = (a.count < b.count) ? b : a;
+			std::size_t const wanted_ranges = 8 * worker_count();
+			if (larger.count < 1024 * wanted_ranges)
+				return set_operation<Kind>(a, b);
+
+			using key_type = typename List::key_type;
+			std::vector<key_type> const splits = splitters(larger, wanted_ranges);
+			std::size_t const ranges = splits.size() + 1;
+
+			// The nodes that begin each range in both lists. The last range ends at the end of the lists.
+			std::vector<std::pair<typename List::node*, typename List::node*>> bounds(ranges + 1);
+			parallel_for(ranges + 1, [&](std::size_t r) {
+				if (r == 0)
+					bounds[r] = { first(a), first(b) };
+				else if (r < ranges)
+					bounds[r] = { first_live(first_not_less(a, splits[r - 1])), first_live(first_not_less(b, splits[r - 1])) };
+			});
+
+			auto const merge_range = [&](std::size_t r, auto&& out) {
+				return merge<Kind>(bounds[r].first, bounds[r + 1].first, bounds[r].second, bounds[r + 1].second, out);
+			};
+
+			// Count the output of every range, and turn the counts into offsets into the result
+			std::vector<std::size_t> offsets(ranges + 1, 0);
+			parallel_for(ranges, [&](std::size_t r) {
+				offsets[r + 1] = merge_range(r, [](auto const*) {});
+			});
+			std::partial_sum(offsets.begin(), offsets.end(), offsets.begin());
+
+			return build<List>(offsets.back(), [&](auto nodes) {
+				parallel_for(ranges, [&](std::size_t r) {
+					std::size_t i = offsets[r];
+					merge_range(r, [&](auto const* n) {
+						construct(nodes, i++, n->data);
+					});
+				});
+			});
+		}
+
+		// Points 'results[i]' to the element with the key 'probes[i]', or to null
+		template <typename List, typename T>
+		constexpr static void find_batch(List const& l, std::span<typename List::key_type const> probes, std::span<T const*> results) {
+			assert(results.size() >= probes.size() && "Not enough room for the results");
+			if (std::ranges::is_sorted(probes)) {
+				resolve_sorted(l, l.head, probes, results, std::views::iota(std::size_t{ 0 }, probes.size()));
+			}
+			else {
+				std::vector<std::size_t> order(probes.size());
+				std::iota(order.begin(), order.end(), std::size_t{ 0 });
+				std::ranges::sort(order, {}, [&](std::size_t i) -> auto const& { return probes[i]; });
+				resolve_sorted(l, l.head, probes, results, order);
+			}
+		}
+
+		// Splits the key space into ranges like the parallel set algorithms, and
+		// partitions the probes by range, so every thread searches its own part
+		// of the list, and sorts its probes to search them with a moving finger.
+		template <typename List, typename T>
+		static void find_batch_parallel(List const& l, std::span<typename List::key_type const> probes, std::span<T const*> results) {
+			assert(results.size() >= probes.size() && "Not enough room for the results");
+			std::size_t const wanted_ranges = 8 * worker_count();
+			if (l.count < 1024 * wanted_ranges || probes.size() < 1024 * wanted_ranges)
+				return find_batch(l, probes, results);
+
+			using key_type = typename List::key_type;
+			std::vector<key_type> const splits = splitters(l, wanted_ranges);
+			std::size_t const ranges = splits.size() + 1;
+
+			// Find the range of every probe, and count the probes of each range in each chunk of probes
+			std::size_t const chunks = wanted_ranges;
+			std::size_t const chunk_size = (probes.size() + chunks - 1) / chunks;
+			std::vector<std::uint32_t> range_of(probes.size());
+			std::vector<std::size_t> counts(chunks * ranges, 0); // indexed by [range][chunk]
+			parallel_for(chunks, [&](std::size_t c) {
+				for (std::size_t i = c * chunk_size; i < std::min(probes.size(), (c + 1) * chunk_size); i++) {
+					auto const r = static_cast<std::uint32_t>(std::ranges::upper_bound(splits, probes[i]) - splits.begin());
+					range_of[i] = r;
+					counts[r * chunks + c] += 1;
+				}
+			});
+
+			// Where each chunk writes the probes of each range, so that the probes
+			// of a range end up together, and in their original order
+			std::exclusive_scan(counts.begin(), counts.end(), counts.begin(), std::size_t{ 0 });
+			std::vector<std::size_t> order(probes.size());
+			parallel_for(chunks, [&](std::size_t c) {
+				for (std::size_t i = c * chunk_size; i < std::min(probes.size(), (c + 1) * chunk_size); i++)
+					order[counts[range_of[i] * chunks + c]++] = i;
+			});
+
+			parallel_for(ranges, [&](std::size_t r) {
+				// After the scatter, 'counts' holds the end of the last chunk of every range
+				std::size_t const first = (r == 0) ? 0 : counts[r * chunks - 1];
+				std::size_t const last = counts[(r + 1) * chunks - 1];
+				std::span<std::size_t> const slice(order.data() + first, last - first);
+				std::ranges::sort(slice, {}, [&](std::size_t i) -> auto const& { return probes[i]; });
+
+				auto* const start = (r == 0) ? l.head : first_not_less(l, splits[r - 1]);
+				resolve_sorted(l, start, probes, results, slice);
+			});
+		}
+
+		// Collects the keys of the elements that are in only one of the lists, by comparing
+		// the hashes of matching key ranges, and only splitting the ranges that differ.
+		// Ranges of a few nodes are compared node by node.
+		template <typename List>
+		constexpr static void diff(List const& a, List const& b, std::vector<typename List::key_type>& out) {
+			diff_range(a, b, { { a.head, {} }, whole(a) }, { { b.head, {} }, whole(b) }, out);
+		}
+
+		// Walks the objects of two intrusive lists like 'merge' walks the nodes of two
+		// power_lists, and calls 'out' with the objects that go in the result
+		template <kind Kind, auto Projection, typename List>
+		constexpr static void merge_objects(List const& a, List const& b, auto&& out) {
+			auto const key = [](auto const& obj) -> decltype(auto) { return std::invoke(Projection, obj); };
+			auto x = a.begin();
+			auto y = b.begin();
+			while (x && y) {
+				if (key(*x) < key(*y)) {
+					if constexpr (Kind == kind::union_)
+						out(*x);
+					++x;
+				}
+				else if (key(*y) < key(*x)) {
+					if constexpr (Kind == kind::union_)
+						out(*y);
+					++y;
+				}
+				else {
+					out(*x);
+					++x;
+					++y;
+				}
+			}
+
+			if constexpr (Kind == kind::union_) {
+				for (; x; ++x)
+					out(*x);
+				for (; y; ++y)
+					out(*y);
+			}
+		}
+
+	private:
+		template <typename Node>
+		constexpr static bool is_live(Node const* n) {
+			if constexpr (requires { { n->dead } -> std::convertible_to<bool>; })
+				return !n->dead;
+			else
+				return true;
+		}
+
+		template <typename Node>
+		constexpr static Node* first_live(Node* n) {
+			while (n && !is_live(n))
+				n = n->next[0];
+			return n;
+		}
+
+		template <typename List>
+		constexpr static auto first(List const& l) {
+			return first_live(l.head);
+		}
+
+		// Returns the first node not less than 'val', or null
+		template <typename List>
+		constexpr static auto first_not_less(List const& l, typename List::key_type const& val) -> typename List::node* {
+			if (l.head == nullptr || val > l.head->next[1]->key())
+				return nullptr;
+			return List::descend(l.head, val);
+		}
+
+		// Resolves the probes in the order given by 'order', which must visit them sorted.
+		// 'start' must not be past the first of them. Null if they are all past the tail.
+		template <typename List, typename T>
+		constexpr static void resolve_sorted(List const& l, typename List::node* start, std::span<typename List::key_type const> probes,
+			std::span<T const*> results, auto const& order) {
+			auto* finger = start;
+			for (std::size_t const i : order) {
+				typename List::key_type const& key = probes[i];
+				if (finger == nullptr || key > l.head->next[1]->key()) {
+					results[i] = nullptr;
+					continue;
+				}
+
+				finger = List::descend(finger, key);
+
+				// Equal keys can follow a dead node
+				auto* match = finger;
+				while (!is_live(match) && match->next[0] && !(key < match->next[0]->key()))
+					match = match->next[0];
+				results[i] = (is_live(match) && match->key() == key) ? &match->data : nullptr;
+			}
+		}
+
+		// A point between two nodes, with the sums of the nodes in front of it.
+		// 'at' is the node after it, and null at the end of the list.
+		template <typename Node>
+		struct cut {
+			Node* at;
+			merkle_sum before;
+		};
+
+		// A run of nodes, 'end' excluded
+		template <typename Node>
+		struct node_run {
+			cut<Node> first;
+			cut<Node> end;
+
+			constexpr merkle_sum sum() const {
+				return end.before - first.before;
+			}
+		};
+
+		template <typename List>
+		constexpr static auto whole(List const& l) -> cut<typename List::node> {
+			return { nullptr, { l.merkle_total, l.count } };
+		}
+
+		// Returns the cut in front of the first node that is not less than 'val'. The
+		// search adds up the spans of the skip links it takes, and the nodes it steps over.
+		template <typename List>
+		constexpr static auto cut_before(List const& l, typename List::key_type const& val) -> cut<typename List::node> {
+			if (l.head == nullptr || val > l.head->next[1]->key())
+				return whole(l);
+
+			auto* n = l.head;
+			merkle_sum before{};
+			while (n->key() < val) {
+				auto* const skip = n->next[1];
+				if (skip->key() < val) {
+					before += n->merkle;
+					n = skip;
+				}
+				else {
+					before += List::merkle_of(n);
+					n = n->next[0];
+				}
+			}
+			return { n, before };
+		}
+
+		// Returns the node at 'index', which must be in the list
+		template <typename List>
+		constexpr static auto node_at(List const& l, std::size_t index) -> typename List::node* {
+			auto* n = l.head;
+			std::size_t at = 0;
+			while (at < index) {
+				auto* const skip = n->next[1];
+				if (skip != n && at + n->merkle.nodes <= index) {
+					at += n->merkle.nodes;
+					n = skip;
+				}
+				else {
+					at += 1;
+					n = n->next[0];
+				}
+			}
+			return n;
+		}
+
+		// Returns the cut in front of the first node in the run that is not less than 'val'
+		template <typename List>
+		constexpr static auto split_run(List const& l, node_run<typename List::node> run, typename List::key_type const& val) -> cut<typename List::node> {
+			if (run.first.at == run.end.at || !(run.first.at->key() < val))
+				return run.first;
+			if (run.end.at && !(run.end.at->key() > val))
+				return run.end;
+			return cut_before(l, val);
+		}
+
+		template <typename List>
+		constexpr static void diff_range(List const& a, List const& b, node_run<typename List::node> ra, node_run<typename List::node> rb, std::vector<typename List::key_type>& out) {
+			merkle_sum const sum_a = ra.sum();
+			merkle_sum const sum_b = rb.sum();
+			if (sum_a.hashes == sum_b.hashes)
+				return;
+
+			if (sum_a.nodes > 8 || sum_b.nodes > 8) {
+				// Split both runs at the key of the middle node of the longer one
+				auto* const middle = (sum_a.nodes >= sum_b.nodes)
+					? node_at(a, ra.first.before.nodes + sum_a.nodes / 2)
+					: node_at(b, rb.first.before.nodes + sum_b.nodes / 2);
+				auto const split_a = split_run(a, ra, middle->key());
+				auto const split_b = split_run(b, rb, middle->key());
+
+				// A run of equal keys can not be split by key
+				if (split_a.at != ra.first.at || split_b.at != rb.first.at) {
+					diff_range(a, b, { ra.first, split_a }, { rb.first, split_b }, out);
+					diff_range(a, b, { split_a, ra.end }, { split_b, rb.end }, out);
+					return;
+				}
+			}
+
+			// Compare the runs node by node
+			auto const live_in_run = [](auto* n, auto* end) {
+				while (n != end && !is_live(n))
+					n = n->next[0];
+				return n;
+			};
+			auto const* const end_a = ra.end.at;
+			auto const* const end_b = rb.end.at;
+			auto const* x = live_in_run(ra.first.at, end_a);
+			auto const* y = live_in_run(rb.first.at, end_b);
+			while (x != end_a || y != end_b) {
+				if (x != end_a && (y == end_b || x->key() < y->key())) {
+					out.push_back(x->key());
+					x = live_in_run(x->next[0], end_a);
+				}
+				else if (y != end_b && (x == end_a || y->key() < x->key())) {
+					out.push_back(y->key());
+					y = live_in_run(y->next[0], end_b);
+				}
+				else {
+					if (!(x->data == y->data))
+						out.push_back(x->key());
+					x = live_in_run(x->next[0], end_a);
+					y = live_in_run(y->next[0], end_b);
+				}
+			}
+		}
+
+		// Picks keys that split the list into about 'wanted' ranges of about equal size.
+		// In a balanced list the nodes after the head form a search tree, where a skip
+		// link starts the second half of the nodes under its node, so the nodes in the
+		// first k levels of the tree split the list into about 2^k even ranges.
+		template <typename List>
+		static std::vector<typename List::key_type> splitters(List const& l, std::size_t wanted) {
+			using node = typename List::node;
+			std::vector<typename List::key_type> keys;
+			std::vector<std::pair<node const*, int>> pending;
+			if (l.head->next[0])
+				pending.push_back({ l.head->next[0], std::bit_width(wanted - 1) });
+			while (!pending.empty()) {
+				auto const [n, levels] = pending.back();
+				pending.pop_back();
+				node const* const second = n->next[1];
+				if (levels == 0 || second == n)
+					continue;
+
+				// A node that links to its neighbour has one half at most, which starts there
+				if (second != n->next[0]) {
+					keys.push_back(second->key());
+					pending.push_back({ n->next[0], levels - 1 });
+				}
+				pending.push_back({ second, levels - 1 });
+			}
+
+			std::ranges::sort(keys);
+			auto const [first, last] = std::ranges::unique(keys);
+			keys.erase(first, last);
+			return keys;
+		}
+
+		// Merges the live nodes of [a, a_end) and [b, b_end), calls 'out' with the nodes
+		// that go in the result, and returns how many there were.
+		// Follows std::set_intersection and std::set_union for elements with equal keys.
+		template <kind Kind, typename Node>
+		constexpr static std::size_t merge(Node const* a, std::type_identity_t<Node const*> a_end, std::type_identity_t<Node const*> b, std::type_identity_t<Node const*> b_end, auto&& out) {
+			std::size_t count = 0;
+			auto const emit = [&](Node const* n) {
+				out(n);
+				count += 1;
+			};
+			auto const advance = [](Node const* n) -> Node const* {
+				return first_live(n->next[0]);
+			};
+
+			while (a != a_end && b != b_end) {
+				if (a->key() < b->key()) {
+					if constexpr (Kind == kind::union_)
+						emit(a);
+					a = advance(a);
+				}
+				else if (b->key() < a->key()) {
+					if constexpr (Kind == kind::union_)
+						emit(b);
+					b = advance(b);
+				}
+				else {
+					emit(a);
+					a = advance(a);
+					b = advance(b);
+				}
+			}
+
+			if constexpr (Kind == kind::union_) {
+				for (; a != a_end; a = advance(a))
+					emit(a);
+				for (; b != b_end; b = advance(b))
+					emit(b);
+			}
+			return count;
+		}
+
+		// Constructs node 'i' of the result, linked to its neighbour
+		template <typename Node, typename T>
+		constexpr static void construct(std::span<Node> nodes, std::size_t i, T const& data) {
+			Node* const next = (i + 1 < nodes.size()) ? &nodes[i + 1] : nullptr;
+			std::construct_at(&nodes[i], Node{ {next, next ? next : &nodes[i]}, data });
+		}
+
+		// Creates a list of 'total' nodes, which 'fill' constructs, and rebalances it
+		template <typename List>
+		constexpr static List build(std::size_t total, auto&& fill) {
+			List result;
+			if (total == 0)
+				return result;
+
+			std::span<typename List::node> nodes;
+			result.alloc.allocate_with_callback(total, [&](std::span<typename List::node> span) {
+				assert(span.size() == total);
+				nodes = span;
+				});
+			fill(nodes);
+
+			result.head = nodes.data();
+			result.count = total;
+			result.needs_rebalance = true;
+			result.rebalance();
+			result.recompute_fingerprint();
+			result.rebuild_index();
+			return result;
+		}
+	};
+}
+
+namespace kg {
+	// Returns the elements of 'a' whose keys are also in 'b'
+	template <typename T, auto Projection, power_list_options Options>
+	constexpr power_list<T, Projection, Options> set_intersection(power_list<T, Projection, Options> const& a, power_list<T, Projection, Options> const& b) {
+		return detail::list_algorithms::set_operation<detail::list_algorithms::kind::intersection>(a, b);
+	}
+
+	// Returns the elements of 'a', and the elements of 'b' whose keys are not in 'a'
+	template <typename T, auto Projection, power_list_options Options>
+	constexpr power_list<T, Projection, Options> set_union(power_list<T, Projection, Options> const& a, power_list<T, Projection, Options> const& b) {
+		return detail::list_algorithms::set_operation<detail::list_algorithms::kind::union_>(a, b);
+	}
+
+	// Parallel versions. The ranges are evenly sized when the larger list is balanced.
+	template <typename T, auto Projection, power_list_options Options>
+	power_list<T, Projection, Options> set_intersection(parallel_t, power_list<T, Projection, Options> const& a, power_list<T, Projection, Options> const& b) {
+		return detail::list_algorithms::set_operation_parallel<detail::list_algorithms::kind::intersection>(a, b);
+	}
+
+	template <typename T, auto Projection, power_list_options Options>
+	power_list<T, Projection, Options> set_union(parallel_t, power_list<T, Projection, Options> const& a, power_list<T, Projection, Options> const& b) {
+		return detail::list_algorithms::set_operation_parallel<detail::list_algorithms::kind::union_>(a, b);
+	}
+
+	// Calls 'out(obj)' with the objects of 'a' whose keys are also in 'b', in order.
+	// The objects are linked in through their hook already, so they can not go in a
+	// result list as well, and are handed to 'out' instead.
+	template <typename T, typename Links, auto Projection>
+	constexpr void set_intersection(basic_intrusive_power_list<T, Links, Projection> const& a, basic_intrusive_power_list<T, Links, Projection> const& b, auto&& out) {
+		detail::list_algorithms::merge_objects<detail::list_algorithms::kind::intersection, Projection>(a, b, out);
+	}
+
+	// Calls 'out(obj)' with the objects of 'a', and the objects of 'b' whose keys are not in 'a', in order
+	template <typename T, typename Links, auto Projection>
+	constexpr void set_union(basic_intrusive_power_list<T, Links, Projection> const& a, basic_intrusive_power_list<T, Links, Projection> const& b, auto&& out) {
+		detail::list_algorithms::merge_objects<detail::list_algorithms::kind::union_, Projection>(a, b, out);
+	}
+
+	// Points 'results[i]' to the element with the key 'probes[i]', or to null.
+	// Unsorted probes are visited through a sorted index.
+	template <typename T, auto Projection, power_list_options Options>
+	constexpr void find_batch(power_list<T, Projection, Options> const& list,
+		std::span<typename power_list<T, Projection, Options>::key_type const> probes, std::span<std::type_identity_t<T> const*> results) {
+		detail::list_algorithms::find_batch(list, probes, results);
+	}
+
+	// Parallel version. Each thread gets the probes of one part of the list at a time.
+	template <typename T, auto Projection, power_list_options Options>
+	void find_batch(parallel_t, power_list<T, Projection, Options> const& list,
+		std::span<typename power_list<T, Projection, Options>::key_type const> probes, std::span<std::type_identity_t<T> const*> results) {
+		detail::list_algorithms::find_batch_parallel(list, probes, results);
+	}
+
+	// Returns the keys of the elements that are in one list but not the other, in
+	// order. Ranges of keys that hash the same in both lists are skipped, so for 'd'
+	// differences it compares O(d log n) ranges, and the hash of each takes a search.
+	template <typename T, auto Projection, power_list_options Options>
+		requires (Options.merkle)
+	constexpr std::vector<typename power_list<T, Projection, Options>::key_type> diff(power_list<T, Projection, Options> const& a, power_list<T, Projection, Options> const& b) {
+		std::vector<typename power_list<T, Projection, Options>::key_type> keys;
+		detail::list_algorithms::diff(a, b, keys);
+		return keys;
+	}
+}
+
+#endif // !POWER_LIST_ALGORITHMS_H
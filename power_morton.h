@@ -0,0 +1,258 @@
+#ifndef POWER_MORTON_H
+#define POWER_MORTON_H
+
+#include "power_list.h"
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cassert>
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+namespace kg {
+	// Z-order (Morton) codes interleave the bits of the coordinates of a point, so
+	// points that are close in space tend to be close in a sorted list of codes.
+	// Bit 'i' of a code is a bit of coordinate 'i % Dims'.
+	template <std::size_t Dims>
+	struct morton {
+		static_assert(Dims >= 2 && Dims <= 8, "Morton codes need 2 to 8 dimensions");
+
+		using point = std::array<std::uint32_t, Dims>;
+		static constexpr std::size_t bits_per_dim = std::min<std::size_t>(32, 64 / Dims);
+		static constexpr std::size_t code_bits = bits_per_dim * Dims;
+
+		// The bits of each coordinate in a code. Masking two codes with the same mask
+		// compares them by that coordinate, without decoding them.
+		static constexpr std::array<std::uint64_t, Dims> dim_masks = [] {
+			std::array<std::uint64_t, Dims> masks{};
+			for (std::size_t bit = 0; bit < code_bits; bit++)
+				masks[bit % Dims] |= std::uint64_t{ 1 } << bit;
+			return masks;
+		}();
+
+		// A box with inclusive corners
+		struct box {
+			point lo, hi;
+
+			constexpr bool contains(point const& p) const {
+				for (std::size_t d = 0; d < Dims; d++) {
+					if (p[d] < lo[d] || p[d] > hi[d])
+						return false;
+				}
+				return true;
+			}
+			constexpr bool contains(std::uint64_t code) const {
+				return contains(decode(code));
+			}
+		};
+
+		// A box as the codes of its corners, for testing codes without decoding them
+		struct code_box {
+			std::uint64_t zmin, zmax;
+
+			constexpr code_box(box const& b) : zmin(encode(b.lo)), zmax(encode(b.hi)) {}
+
+			constexpr bool contains(std::uint64_t code) const {
+				for (std::uint64_t mask : dim_masks) {
+					if ((code & mask) < (zmin & mask) || (code & mask) > (zmax & mask))
+						return false;
+				}
+				return true;
+			}
+		};
+
+		// A run of codes that a box covers part of. The run is 'exact' if every code in it is in the box.
+		struct code_range {
+			std::uint64_t first, last;
+			bool exact;
+		};
+
+		static constexpr std::uint64_t encode(point const& p) {
+			std::uint64_t code = 0;
+			for (std::size_t bit = 0; bit < bits_per_dim; bit++) {
+				for (std::size_t d = 0; d < Dims; d++) {
+					assert(std::uint64_t{ p[d] } >> bits_per_dim == 0 && "Coordinate is too large");
+					code |= std::uint64_t{ (p[d] >> bit) & 1 } << (bit * Dims + d);
+				}
+			}
+			return code;
+		}
+
+		static constexpr point decode(std::uint64_t code) {
+			point p{};
+			for (std::size_t bit = 0; bit < bits_per_dim; bit++) {
+				for (std::size_t d = 0; d < Dims; d++)
+					p[d] |= static_cast<std::uint32_t>((code >> (bit * Dims + d)) & 1) << bit;
+			}
+			return p;
+		}
+
+		// The smallest code greater than 'code' that is in the box, or 0 if there is none.
+		// This is BIGMIN from Tropf and Herzog, 'Multidimensional Range Search in Dynamically Balanced Trees'.
+		static constexpr std::uint64_t bigmin(std::uint64_t code, code_box const& b) {
+			std::uint64_t zmin = b.zmin, zmax = b.zmax;
+			std::uint64_t result = 0;
+			for (std::size_t bit = code_bits; bit-- > 0;) {
+				switch (corner_bits(code, zmin, zmax, bit)) {
+				case 0b001:
+					result = with_high_bit(zmin, bit);
+					zmax = with_low_bits(zmax, bit);
+					break;
+				case 0b011:
+					return zmin;
+				case 0b100:
+					return result;
+				case 0b101:
+					zmin = with_high_bit(zmin, bit);
+					break;
+				default: // the bit is the same in all three, so keep going
+					assert(corner_bits(code, zmin, zmax, bit) != 0b010 && corner_bits(code, zmin, zmax, bit) != 0b110);
+					break;
+				}
+			}
+			return result;
+		}
+
+		// The largest code less than 'code' that is in the box, or 0 if there is none. This is LITMAX.
+		static constexpr std::uint64_t litmax(std::uint64_t code, code_box const& b) {
+			std::uint64_t zmin = b.zmin, zmax = b.zmax;
+			std::uint64_t result = 0;
+			for (std::size_t bit = code_bits; bit-- > 0;) {
+				switch (corner_bits(code, zmin, zmax, bit)) {
+				case 0b001:
+					zmax = with_low_bits(zmax, bit);
+					break;
+				case 0b011:
+					return result;
+				case 0b100:
+					return zmax;
+				case 0b101:
+					result = with_low_bits(zmax, bit);
+					zmin = with_high_bit(zmin, bit);
+					break;
+				default:
+					break;
+				}
+			}
+			return result;
+		}
+
+		// Splits the codes from the low to the high corner of the box into at most
+		// 'max_ranges' sorted runs. The box is halved at the highest bit its corners
+		// differ in, which splits the run at LITMAX and BIGMIN of the halving point,
+		// until the runs are exact or there would be too many.
+		static constexpr std::vector<code_range> ranges(box const& b, std::size_t max_ranges = 16) {
+			assert(max_ranges > 0);
+			std::vector<code_range> runs{ range_of(b) };
+			std::vector<box> boxes{ b };
+			while (true) {
+				std::size_t const inexact = static_cast<std::size_t>(std::ranges::count(runs, false, &code_range::exact));
+				if (inexact == 0 || runs.size() + inexact > max_ranges)
+					return runs;
+
+				std::vector<code_range> next_runs;
+				std::vector<box> next_boxes;
+				for (std::size_t i = 0; i < runs.size(); i++) {
+					if (runs[i].exact) {
+						next_runs.push_back(runs[i]);
+						next_boxes.push_back(boxes[i]);
+						continue;
+					}
+					auto const [low, high] = halve(boxes[i]);
+					next_runs.push_back(range_of(low));
+					next_runs.push_back(range_of(high));
+					next_boxes.push_back(low);
+					next_boxes.push_back(high);
+				}
+				runs = std::move(next_runs);
+				boxes = std::move(next_boxes);
+			}
+		}
+
+	private:
+		// The bits of 'code', 'zmin' and 'zmax' at 'bit', as 0bCLH
+		static constexpr int corner_bits(std::uint64_t code, std::uint64_t zmin, std::uint64_t zmax, std::size_t bit) {
+			return static_cast<int>(((code >> bit) & 1) << 2 | ((zmin >> bit) & 1) << 1 | ((zmax >> bit) & 1));
+		}
+
+		// The bits of the same coordinate as 'bit' that are below it
+		static constexpr std::uint64_t lower_bits_of_dim(std::size_t bit) {
+			return dim_masks[bit % Dims] & ((std::uint64_t{ 1 } << bit) - 1);
+		}
+
+		// 'code' with its coordinate at 'bit' changed to 1000.. from 'bit' down
+		static constexpr std::uint64_t with_high_bit(std::uint64_t code, std::size_t bit) {
+			return (code & ~lower_bits_of_dim(bit)) | (std::uint64_t{ 1 } << bit);
+		}
+
+		// 'code' with its coordinate at 'bit' changed to 0111.. from 'bit' down
+		static constexpr std::uint64_t with_low_bits(std::uint64_t code, std::size_t bit) {
+			return (code | lower_bits_of_dim(bit)) & ~(std::uint64_t{ 1 } << bit);
+		}
+
+		static constexpr code_range range_of(box const& b) {
+			std::uint64_t const first = encode(b.lo), last = encode(b.hi);
+
+			// The run is exact when it is exactly as long as the box has points
+			std::uint64_t volume = 1;
+			for (std::size_t d = 0; d < Dims; d++)
+				volume *= std::uint64_t{ b.hi[d] - b.lo[d] } + 1;
+			return { first, last, last - first + 1 == volume };
+		}
+
+		static constexpr std::pair<box, box> halve(box const& b) {
+			std::uint64_t const first = encode(b.lo), last = encode(b.hi);
+			std::size_t const bit = static_cast<std::size_t>(std::bit_width(first ^ last) - 1);
+			std::size_t const d = bit % Dims;
+			std::uint32_t const split = static_cast<std::uint32_t>((b.hi[d] >> (bit / Dims)) << (bit / Dims));
+
+			box low = b, high = b;
+			low.hi[d] = split - 1;
+			high.lo[d] = split;
+			return { low, high };
+		}
+	};
+
+	// Calls 'fn' with each element of 'list' that has a Morton code key inside 'b', in code order.
+	// The box is split into code runs with 'morton::ranges'. Exact runs are scanned straight
+	// through. Inside the others, a key outside the box makes the scan jump to the next key in
+	// the box with BIGMIN. Jumps step over short gaps, and search on from the current key over long ones.
+	template <std::size_t Dims, typename T, auto Projection, power_list_options Options>
+	constexpr void morton_box_query(power_list<T, Projection, Options> const& list, typename morton<Dims>::box const& b, auto&& fn, std::size_t max_ranges = 16) {
+		constexpr int max_steps = 8; // nodes to walk over before searching instead
+		auto const key = [](T const& val) -> std::uint64_t { return std::invoke(Projection, val); };
+		typename morton<Dims>::code_box const codes(b);
+
+		auto const runs = morton<Dims>::ranges(b, max_ranges);
+		auto it = list.lower_bound(runs.front().first);
+		auto const seek = [&](std::uint64_t target) {
+			for (int steps = 0; it && key(*it) < target; steps++) {
+				if (steps == max_steps) {
+					it = list.lower_bound(it, target);
+					return;
+				}
+				++it;
+			}
+		};
+
+		for (auto const& run : runs) {
+			seek(run.first);
+			while (it && key(*it) <= run.last) {
+				std::uint64_t const code = key(*it);
+				if (run.exact || codes.contains(code)) {
+					fn(*it);
+					++it;
+					continue;
+				}
+
+				std::uint64_t const next = morton<Dims>::bigmin(code, codes);
+				if (next <= code || next > run.last)
+					break;
+				seek(next);
+			}
+		}
+	}
+}
+
+#endif // !POWER_MORTON_H
@@ -0,0 +1,223 @@
+#ifndef POWER_MULTI_INDEX_H
+#define POWER_MULTI_INDEX_H
+
+#include "scatter_allocator.h"
+#include "intrusive_power_list.h"
+#include <cassert>
+#include <functional>
+#include <iterator>
+#include <tuple>
+#include <utility>
+
+namespace kg {
+	// Keeps the same elements in several orderings at once, one per projection.
+	// Each element is allocated once, and its node carries a pair of links for
+	// every index. Every index is searched and rebalanced on its own, and erasing
+	// through any of them unlinks the element from all of them.
+	//
+	//   power_multi_index<trade, &trade::id, &trade::timestamp, &trade::price> trades;
+	//   auto it = trades.get<1>().lower_bound(start_time);
+	template <typename T, auto... Projections>
+	class power_multi_index {
+		static_assert(sizeof...(Projections) > 0, "A multi-index needs at least one index");
+		static constexpr std::size_t index_count = sizeof...(Projections);
+
+		struct node {
+			node* next[index_count][2];
+			T data;
+		};
+
+		template <std::size_t I>
+		struct index_links {
+			constexpr node** operator()(node* n) const {
+				return n->next[I];
+			}
+		};
+
+		template <auto Projection>
+		struct data_projection {
+			constexpr decltype(auto) operator()(node const& n) const {
+				return std::invoke(Projection, n.data);
+			}
+		};
+
+		template <std::size_t I>
+		using list_type = basic_intrusive_power_list<node, index_links<I>, data_projection<std::get<I>(std::tuple{ Projections... })>{}>;
+
+		template <std::size_t... Is>
+		static auto make_lists(std::index_sequence<Is...>) -> std::tuple<list_type<Is>...>;
+		using lists_type = decltype(make_lists(std::make_index_sequence<index_count>{}));
+
+	public:
+		// A view of the elements through one of the orderings
+		template <std::size_t I>
+		class index {
+			friend class power_multi_index;
+
+		public:
+			using key_type = typename list_type<I>::key_type;
+
+			struct iterator {
+				friend class index;
+
+				// iterator traits
+				using difference_type = ptrdiff_t;
+				using value_type = T;
+				using pointer = const T*;
+				using reference = const T&;
+				using iterator_category = std::forward_iterator_tag;
+
+				constexpr iterator() noexcept = default;
+				constexpr iterator(node* n) noexcept : curr(n) {}
+
+				constexpr iterator& operator++() {
+					assert(curr != nullptr && "Trying to step past end of list");
+					curr = curr->next[I][0];
+					return *this;
+				}
+
+				constexpr iterator operator++(int) {
+					iterator const retval = *this;
+					++(*this);
+					return retval;
+				}
+
+				constexpr bool operator==(std::default_sentinel_t) const {
+					return curr == nullptr;
+				}
+
+				constexpr bool operator==(iterator const& other) const {
+					return curr == other.curr;
+				}
+
+				constexpr operator bool() const {
+					return curr != nullptr;
+				}
+
+				constexpr reference operator*() const {
+					assert(curr != nullptr && "Dereferencing null");
+					return curr->data;
+				}
+
+				constexpr pointer operator->() const {
+					assert(curr != nullptr && "Dereferencing null");
+					return &curr->data;
+				}
+
+			private:
+				node* curr{};
+			};
+
+			[[nodiscard]] constexpr iterator begin() const {
+				return { list().empty() ? nullptr : &list().front() };
+			}
+			[[nodiscard]] constexpr std::default_sentinel_t end() const {
+				return {};
+			}
+
+			[[nodiscard]] constexpr std::size_t size() const {
+				return list().size();
+			}
+
+			[[nodiscard]] constexpr iterator find(key_type const& key) const {
+				return { list().find(key) };
+			}
+
+			[[nodiscard]] constexpr iterator lower_bound(key_type const& key) const {
+				auto const it = list().lower_bound(key);
+				return { it ? &*it : nullptr };
+			}
+
+			[[nodiscard]] constexpr bool contains(key_type const& key) const {
+				return list().contains(key);
+			}
+
+			// Erases the element from all the indices
+			constexpr void erase(iterator it) {
+				if (it)
+					owner->erase_node(it.curr);
+			}
+
+			constexpr void rebalance() {
+				list().rebalance();
+			}
+
+		private:
+			constexpr index(power_multi_index* owner) : owner(owner) {}
+
+			constexpr list_type<I>& list() const {
+				return std::get<I>(owner->lists);
+			}
+
+			power_multi_index* owner;
+		};
+
+		constexpr power_multi_index() = default;
+		constexpr power_multi_index(power_multi_index const&) = delete;
+		constexpr power_multi_index(power_multi_index&& other) noexcept
+			: lists(std::move(other.lists)), alloc(std::move(other.alloc)) {
+		}
+
+		constexpr ~power_multi_index() {
+			destroy_nodes();
+		}
+
+		template <std::size_t I>
+		[[nodiscard]] constexpr index<I> get() {
+			static_assert(I < index_count, "Index out of range");
+			return { this };
+		}
+
+		[[nodiscard]] constexpr std::size_t size() const {
+			return std::get<0>(lists).size();
+		}
+
+		[[nodiscard]] constexpr bool empty() const {
+			return std::get<0>(lists).empty();
+		}
+
+		constexpr void clear() {
+			destroy_nodes();
+			lists = lists_type{};
+			alloc = scatter_allocator<node>{};
+		}
+
+		// Inserts a copy of 'val' into all the indices, with a single allocation
+		constexpr void insert(T val) {
+			node* n = alloc.allocate_one();
+			std::construct_at(n, node{ {}, std::move(val) });
+			for_each_list([n](auto& list) { list.insert(*n); });
+		}
+
+		constexpr void rebalance() {
+			for_each_list([](auto& list) { list.rebalance(); });
+		}
+
+	private:
+		constexpr void for_each_list(auto&& fn) {
+			std::apply([&fn](auto&... list) { (fn(list), ...); }, lists);
+		}
+
+		constexpr void erase_node(node* n) {
+			for_each_list([n](auto& list) { list.erase(*n); });
+			std::destroy_at(n);
+			alloc.deallocate({ n, 1 });
+		}
+
+		constexpr void destroy_nodes() {
+			if (empty())
+				return;
+
+			node* n = &std::get<0>(lists).front();
+			while (n) {
+				node* next = n->next[0][0];
+				std::destroy_at(n);
+				n = next;
+			}
+		}
+
+		lists_type lists;
+		scatter_allocator<node> alloc;
+	};
+}
+#endif
@@ -0,0 +1,176 @@
+#ifndef POWER_NORMALIZED_KEY_H
+#define POWER_NORMALIZED_KEY_H
+
+#include "power_list.h"
+#include <array>
+#include <bit>
+#include <concepts>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <string_view>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+
+namespace kg {
+	namespace detail {
+		template <typename K>
+		struct is_tuple_like : std::false_type {};
+		template <typename... Ts>
+		struct is_tuple_like<std::tuple<Ts...>> : std::true_type {};
+		template <typename A, typename B>
+		struct is_tuple_like<std::pair<A, B>> : std::true_type {};
+		template <typename U, std::size_t N>
+		struct is_tuple_like<std::array<U, N>> : std::true_type {};
+
+		template <typename K>
+		concept string_like = std::convertible_to<K const&, std::string_view> && !std::is_arithmetic_v<K>;
+
+		// The number of bytes 'K' normalizes to, or 0 if it depends on the value
+		template <typename K>
+		consteval std::size_t normalized_width() {
+			if constexpr (std::is_enum_v<K>)
+				return sizeof(K);
+			else if constexpr (std::is_arithmetic_v<K>)
+				return std::is_same_v<K, bool> ? 1 : sizeof(K);
+			else if constexpr (string_like<K>)
+				return 0;
+			else if constexpr (is_tuple_like<K>::value) {
+				return []<std::size_t... I>(std::index_sequence<I...>) {
+					std::size_t const widths[] = { normalized_width<std::tuple_element_t<I, K>>()..., 1 };
+					std::size_t total = 0;
+					for (std::size_t i = 0; i < sizeof...(I); i++) {
+						if (widths[i] == 0)
+							return std::size_t{ 0 };
+						total += widths[i];
+					}
+					return total;
+				}(std::make_index_sequence<std::tuple_size_v<K>>{});
+			}
+			else {
+				static_assert(!sizeof(K), "Can not normalize this key type");
+				return 0;
+			}
+		}
+
+		// Writes the big-endian 'bytes' low bytes of 'bits'
+		constexpr void put_bytes(auto& sink, std::uint64_t bits, std::size_t bytes) {
+			for (std::size_t i = bytes; i-- > 0;)
+				sink.put(static_cast<std::uint8_t>(bits >> (i * 8)));
+		}
+
+		template <typename K>
+		constexpr void normalize_into(auto& sink, K const& key) {
+			if constexpr (std::is_enum_v<K>) {
+				normalize_into(sink, static_cast<std::underlying_type_t<K>>(key));
+			}
+			else if constexpr (std::is_same_v<K, bool>) {
+				sink.put(key ? 1 : 0);
+			}
+			else if constexpr (std::is_integral_v<K>) {
+				// Flipping the sign bit puts negative numbers before positive ones
+				auto bits = static_cast<std::uint64_t>(static_cast<std::make_unsigned_t<K>>(key));
+				if constexpr (std::is_signed_v<K>)
+					bits ^= std::uint64_t{ 1 } << (sizeof(K) * 8 - 1);
+				put_bytes(sink, bits, sizeof(K));
+			}
+			else if constexpr (std::is_floating_point_v<K>) {
+				static_assert(sizeof(K) == 4 || sizeof(K) == 8, "Only 32 and 64 bit floating point keys can be normalized");
+				using bits_type = std::conditional_t<sizeof(K) == 4, std::uint32_t, std::uint64_t>;
+				constexpr bits_type sign = bits_type{ 1 } << (sizeof(K) * 8 - 1);
+
+				// Negative numbers have all bits flipped, so bigger magnitudes come first.
+				// Positive ones only have the sign bit flipped. -0.0 sorts before 0.0.
+				bits_type bits = std::bit_cast<bits_type>(key);
+				bits = (bits & sign) ? ~bits : (bits | sign);
+				put_bytes(sink, bits, sizeof(K));
+			}
+			else if constexpr (string_like<K>) {
+				// Zero bytes are escaped as 00 ff, and the string ends with 00 00, so a
+				// string sorts before any longer string that starts with it, and the
+				// fields that follow it do not affect the order.
+				for (char c : std::string_view(key)) {
+					sink.put(static_cast<std::uint8_t>(c));
+					if (c == '\0')
+						sink.put(0xff);
+				}
+				sink.put(0);
+				sink.put(0);
+			}
+			else {
+				std::apply([&](auto const&... fields) { (normalize_into(sink, fields), ...); }, key);
+			}
+		}
+
+		struct string_sink {
+			std::string& out;
+			constexpr void put(std::uint8_t byte) {
+				out.push_back(static_cast<char>(byte));
+			}
+		};
+
+		struct integer_sink {
+			std::uint64_t value = 0;
+			constexpr void put(std::uint8_t byte) {
+				value = value << 8 | byte;
+			}
+		};
+	}
+
+	// The type 'K' normalizes to. Keys that always fit in 8 bytes become integers,
+	// and all others become byte strings.
+	template <typename K>
+	using normalized_key_t = std::conditional_t<detail::normalized_width<K>() != 0 && detail::normalized_width<K>() <= 8, std::uint64_t, std::string>;
+
+	// Encodes 'key' so that comparing the encodings, as unsigned integers or with
+	// 'memcmp', orders keys the same way 'operator<' on the keys does.
+	// Integers, enums, bools, floats, strings, and tuples, pairs and arrays of them
+	// are supported. NaNs are ordered by their bits.
+	template <typename K>
+	constexpr normalized_key_t<K> normalize_key(K const& key) {
+		if constexpr (std::is_same_v<normalized_key_t<K>, std::uint64_t>) {
+			detail::integer_sink sink;
+			detail::normalize_into(sink, key);
+			return sink.value;
+		}
+		else {
+			std::string out;
+			if constexpr (detail::normalized_width<K>() != 0)
+				out.reserve(detail::normalized_width<K>());
+			detail::string_sink sink{ out };
+			detail::normalize_into(sink, key);
+			return out;
+		}
+	}
+
+	// An element, and the normalized form of its key
+	template <typename T, auto Projection = std::identity{}>
+	struct normalized {
+		using key_type = std::remove_cvref_t<std::invoke_result_t<decltype(Projection) const&, T const&>>;
+
+		normalized_key_t<key_type> key;
+		T value;
+
+		constexpr normalized(T value)
+			: key(normalize_key(std::invoke(Projection, value))), value(std::move(value)) {
+		}
+	};
+
+	namespace detail {
+		template <typename K>
+		constexpr power_list_options normalized_options(power_list_options options) {
+			options.key_prefix = std::is_same_v<normalized_key_t<K>, std::string>;
+			return options;
+		}
+	}
+
+	// A list that orders elements by their normalized keys only, so every comparison
+	// in a search is one integer compare, or for variable-length keys an integer compare
+	// of the inline prefixes and a 'memcmp' on ties. Search with 'normalize_key(key)'.
+	template <typename T, auto Projection = std::identity{}, power_list_options Options = {}>
+	using power_normalized_list = power_list<normalized<T, Projection>, &normalized<T, Projection>::key,
+		detail::normalized_options<typename normalized<T, Projection>::key_type>(Options)>;
+}
+
+#endif // !POWER_NORMALIZED_KEY_H
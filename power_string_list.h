@@ -0,0 +1,171 @@
+#ifndef POWER_STRING_LIST_H
+#define POWER_STRING_LIST_H
+
+#include "power_list.h"
+#include <algorithm>
+#include <cassert>
+#include <cstdint>
+#include <ranges>
+#include <string_view>
+#include <vector>
+
+namespace kg {
+	// A view of a string in a 'string_arena'
+	struct arena_string {
+		char const* data;
+		std::uint32_t size;
+
+		constexpr std::string_view view() const {
+			return { data, size };
+		}
+	};
+
+	// Copies strings into large chunks of memory, one after another. The strings are
+	// never freed on their own, only all at once when the arena is destroyed.
+	class string_arena {
+	public:
+		constexpr arena_string store(std::string_view str) {
+			assert(str.size() <= UINT32_MAX && "String is too long");
+			if (str.empty())
+				return { nullptr, 0 };
+			if (remaining < str.size()) {
+				std::size_t const size = std::max({ min_chunk_size, str.size(), chunks.empty() ? 0 : 2 * chunks.back().size() });
+				chunks.emplace_back(size);
+				used = 0;
+				remaining = size;
+			}
+
+			char* const data = chunks.back().data() + used;
+			std::ranges::copy(str, data);
+			used += str.size();
+			remaining -= str.size();
+			bytes += str.size();
+			return { data, static_cast<std::uint32_t>(str.size()) };
+		}
+
+		// The number of bytes stored
+		[[nodiscard]] constexpr std::size_t size() const {
+			return bytes;
+		}
+
+	private:
+		static constexpr std::size_t min_chunk_size = 4096;
+
+		std::vector<std::vector<char>> chunks;
+		std::size_t used = 0;
+		std::size_t remaining = 0;
+		std::size_t bytes = 0;
+	};
+
+	// A sorted list of strings, where the characters of every string live in an arena
+	// owned by the list, and the nodes hold a pointer and a length. Inserting costs one
+	// node allocation, with nothing to allocate per string, and the list is destroyed by
+	// freeing its pools and chunks. The bytes of removed strings are reclaimed by
+	// 'rebalance' once they are more than half of the arena.
+	template <power_list_options Options = {}>
+	class power_string_list {
+		using list_type = power_list<arena_string, &arena_string::view, Options>;
+
+	public:
+		using iterator = typename list_type::iterator;
+
+		constexpr power_string_list() = default;
+		power_string_list(power_string_list const&) = delete;
+		power_string_list& operator=(power_string_list const&) = delete;
+		constexpr power_string_list(power_string_list&&) = default;
+		constexpr power_string_list& operator=(power_string_list&&) = default;
+
+		// 'range' must be sorted
+		constexpr power_string_list(std::ranges::sized_range auto const& range) {
+			std::vector<arena_string> strings;
+			strings.reserve(std::ranges::size(range));
+			for (std::string_view str : range)
+				strings.push_back(arena.store(str));
+			list.assign_range(strings);
+		}
+
+		constexpr void insert(std::string_view str) {
+			list.insert(arena.store(str));
+		}
+
+		constexpr void remove(std::string_view str) {
+			if (auto const it = list.find(str)) {
+				removed_bytes += it->size;
+				list.erase(it);
+			}
+		}
+
+		[[nodiscard]] constexpr iterator find(std::string_view str) const {
+			return list.find(str);
+		}
+
+		[[nodiscard]] constexpr iterator lower_bound(std::string_view str) const {
+			return list.lower_bound(str);
+		}
+
+		[[nodiscard]] constexpr bool contains(std::string_view str) const {
+			return list.contains(str);
+		}
+
+		[[nodiscard]] constexpr auto prefix_range(std::string_view prefix) const {
+			return list.prefix_range(prefix);
+		}
+
+		[[nodiscard]] constexpr iterator begin() const {
+			return list.begin();
+		}
+
+		[[nodiscard]] constexpr std::default_sentinel_t end() const {
+			return list.end();
+		}
+
+		[[nodiscard]] constexpr std::size_t size() const {
+			return list.size();
+		}
+
+		[[nodiscard]] constexpr bool empty() const {
+			return list.empty();
+		}
+
+		// The bytes in the arena, including those of removed strings
+		[[nodiscard]] constexpr std::size_t arena_size() const {
+			return arena.size();
+		}
+
+		// Rebalances the list. If removed strings take up more than half of the arena,
+		// the strings are copied into a new arena and the nodes into new pools, both
+		// in list order, in one pass.
+		constexpr void rebalance() {
+			if (removed_bytes * 2 <= arena.size()) {
+				list.rebalance();
+				return;
+			}
+
+			string_arena compacted;
+			std::vector<arena_string> strings;
+			strings.reserve(list.size());
+			for (arena_string const& str : list.template prefetched<8>())
+				strings.push_back(compacted.store(str.view()));
+
+			list_type rebuilt;
+			rebuilt.assign_range(strings);
+			list = std::move(rebuilt);
+			arena = std::move(compacted);
+			removed_bytes = 0;
+		}
+
+		constexpr void clear() {
+			list.clear();
+			arena = {};
+			removed_bytes = 0;
+		}
+
+	private:
+		// Declared before the list, so the strings outlive the nodes that point to them
+		string_arena arena;
+		list_type list;
+		std::size_t removed_bytes = 0;
+	};
+}
+
+#endif // !POWER_STRING_LIST_H
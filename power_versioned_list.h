@@ -0,0 +1,422 @@
+#ifndef POWER_VERSIONED_LIST_H
+#define POWER_VERSIONED_LIST_H
+
+#include "scatter_allocator.h"
+#include "balance_helper.h"
+#include <cassert>
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <iterator>
+#include <limits>
+#include <map>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+namespace kg {
+	// A sorted set where every change creates a new version. Readers open a view
+	// at the latest version and see that version, and only that version, for as
+	// long as the view is open, without locking and without blocking writers.
+	//
+	// * Any number of readers can run concurrently with the writers.
+	// * Writers are serialized by an internal mutex.
+	// * Erased elements stay in the list until 'collect' finds that no open view
+	//   can see them. Their memory is reused once no reader can be standing on them.
+	template <typename T, auto Projection = std::identity{}>
+	class power_versioned_list {
+	public:
+		using key_type = std::remove_cvref_t<std::invoke_result_t<decltype(Projection) const&, T const&>>;
+		using version_type = std::uint64_t;
+
+	private:
+		static constexpr version_type never = std::numeric_limits<version_type>::max();
+
+		struct node {
+			node* next[2];
+			T data;
+			version_type begin; // the first version that sees this node
+			version_type end;   // the first version that no longer sees it
+
+			decltype(auto) key() const {
+				return std::invoke(Projection, data);
+			}
+
+			bool visible_at(version_type v) const {
+				return begin <= v && v < load_end(this);
+			}
+		};
+
+		using balance_helper = detail::balance_helper<node>;
+
+	public:
+		// A consistent, read-only view of the list at one version
+		class read_view {
+			friend class power_versioned_list;
+
+		public:
+			struct iterator {
+				// iterator traits
+				using difference_type = ptrdiff_t;
+				using value_type = T;
+				using pointer = const T*;
+				using reference = const T&;
+				using iterator_category = std::forward_iterator_tag;
+
+				iterator() noexcept = default;
+				iterator(node* n, version_type v) noexcept : curr(n), version(v) {
+					skip_invisible();
+				}
+
+				iterator& operator++() {
+					assert(curr != nullptr && "Trying to step past end of list");
+					curr = load(curr->next[0]);
+					skip_invisible();
+					return *this;
+				}
+
+				iterator operator++(int) {
+					iterator const retval = *this;
+					++(*this);
+					return retval;
+				}
+
+				bool operator==(std::default_sentinel_t) const {
+					return curr == nullptr;
+				}
+
+				bool operator==(iterator const& other) const {
+					return curr == other.curr;
+				}
+
+				reference operator*() const {
+					assert(curr != nullptr && "Dereferencing null");
+					return curr->data;
+				}
+
+				pointer operator->() const {
+					assert(curr != nullptr && "Dereferencing null");
+					return &curr->data;
+				}
+
+			private:
+				void skip_invisible() {
+					while (curr && !curr->visible_at(version))
+						curr = load(curr->next[0]);
+				}
+
+				node* curr{};
+				version_type version{};
+			};
+
+			read_view(read_view const&) = delete;
+			read_view(read_view&& other) noexcept
+				: list(std::exchange(other.list, nullptr)), ver(other.ver), ticket(other.ticket) {
+			}
+			read_view& operator=(read_view const&) = delete;
+			read_view& operator=(read_view&&) = delete;
+
+			~read_view() {
+				if (list)
+					list->close_view(ticket);
+			}
+
+			[[nodiscard]] version_type version() const {
+				return ver;
+			}
+
+			[[nodiscard]] iterator begin() const {
+				return { load(list->head), ver };
+			}
+			[[nodiscard]] std::default_sentinel_t end() const {
+				return {};
+			}
+
+			// Returns the element with the key, or null
+			[[nodiscard]] T const* find(key_type const& key) const {
+				for (node* n = list->lower_bound_node(key); n && n->key() == key; n = load(n->next[0])) {
+					if (n->visible_at(ver))
+						return &n->data;
+				}
+				return nullptr;
+			}
+
+			[[nodiscard]] bool contains(key_type const& key) const {
+				return nullptr != find(key);
+			}
+
+			// Calls 'fn' with each element with a key in [lo, hi]
+			void scan(key_type const& lo, key_type const& hi, auto&& fn) const {
+				for (node* n = list->lower_bound_node(lo); n && !(hi < n->key()); n = load(n->next[0])) {
+					if (n->visible_at(ver))
+						fn(n->data);
+				}
+			}
+
+		private:
+			read_view(power_versioned_list const* list, version_type ver, std::uint64_t ticket)
+				: list(list), ver(ver), ticket(ticket) {
+			}
+
+			power_versioned_list const* list;
+			version_type ver;
+			std::uint64_t ticket;
+		};
+
+		power_versioned_list() = default;
+		power_versioned_list(power_versioned_list const&) = delete;
+		power_versioned_list& operator=(power_versioned_list const&) = delete;
+
+		~power_versioned_list() {
+			assert(views.empty() && "Destroying a list with open read views");
+			for (auto& batch : retired)
+				for (node* n : batch.nodes)
+					std::destroy_at(n);
+
+			node* n = head;
+			while (n) {
+				node* next = n->next[0];
+				std::destroy_at(n);
+				n = next;
+			}
+		}
+
+		// Opens a view of the latest version
+		[[nodiscard]] read_view read() const {
+			std::scoped_lock lock(view_mutex);
+			std::uint64_t const ticket = next_ticket++;
+			version_type const v = current.load(std::memory_order_acquire);
+			views.emplace(ticket, v);
+			return { this, v, ticket };
+		}
+
+		// The latest version
+		[[nodiscard]] version_type version() const {
+			return current.load(std::memory_order_acquire);
+		}
+
+		// The number of elements in the latest version
+		[[nodiscard]] std::size_t size() const {
+			return live_count.load(std::memory_order_relaxed);
+		}
+
+		// Inserts an element, unless the latest version already has its key
+		bool insert(T val) {
+			std::scoped_lock lock(write_mutex);
+			decltype(auto) key = std::invoke(Projection, val);
+
+			// Find the node to link in front of. New nodes go in front of the older
+			// versions of their key, so the search finds them first.
+			node* prev = nullptr;
+			node* curr = head;
+			if (curr && curr->key() < key) {
+				node* n = head;
+				while (true) {
+					node* const next = n->next[0];
+					if (next == nullptr || !(next->key() < key)) {
+						prev = n;
+						curr = next;
+						break;
+					}
+					n = (n->next[1]->key() < key) ? n->next[1] : next;
+				}
+			}
+
+			for (node* n = curr; n && n->key() == key; n = n->next[0]) {
+				if (load_end(n) == never)
+					return false;
+			}
+
+			version_type const v = current.load(std::memory_order_relaxed) + 1;
+			node* n = alloc.allocate_one();
+			std::construct_at(n, node{ {curr, curr ? curr->next[1] : n}, std::move(val), v, never });
+
+			// The new node is complete before it is published, and the tail
+			// never links to itself once it is no longer the tail.
+			if (prev == nullptr) { // new head
+				if (head)
+					n->next[1] = head->next[1];
+				store(head, n);
+			}
+			else if (curr == nullptr) { // new tail
+				store(prev->next[1], n);
+				store(prev->next[0], n);
+				store(head->next[1], n);
+			}
+			else { // middle
+				store(prev->next[0], n);
+			}
+
+			node_count += 1;
+			live_count.fetch_add(1, std::memory_order_relaxed);
+			needs_rebalance = true;
+			current.store(v, std::memory_order_release);
+			return true;
+		}
+
+		// Erases the element with the key from the latest version.
+		// Views of earlier versions still see it.
+		bool remove(key_type const& key) {
+			std::scoped_lock lock(write_mutex);
+			for (node* n = lower_bound_node(key); n && n->key() == key; n = n->next[0]) {
+				if (load_end(n) == never) {
+					version_type const v = current.load(std::memory_order_relaxed) + 1;
+					std::atomic_ref<version_type>(n->end).store(v, std::memory_order_release);
+					live_count.fetch_sub(1, std::memory_order_relaxed);
+					current.store(v, std::memory_order_release);
+					return true;
+				}
+			}
+			return false;
+		}
+
+		// Unlinks the versions that no open view can see, and frees the ones
+		// that no reader can be standing on any more.
+		void collect() {
+			std::scoped_lock lock(write_mutex);
+
+			version_type oldest = current.load(std::memory_order_relaxed);
+			{
+				std::scoped_lock view_lock(view_mutex);
+				for (auto const& [ticket, v] : views)
+					oldest = std::min(oldest, v);
+			}
+			auto const is_dead = [oldest](node const* n) { return load_end(n) <= oldest; };
+
+			// Unlink dead nodes from the list
+			std::vector<node*> unlinked;
+			node* prev = nullptr;
+			for (node* n = head; n; n = n->next[0]) {
+				if (is_dead(n)) {
+					unlinked.push_back(n);
+					store(prev ? prev->next[0] : head, n->next[0]);
+				}
+				else {
+					prev = n;
+				}
+			}
+
+			if (!unlinked.empty()) {
+				node* const tail = prev;
+
+				// Move skip links off the unlinked nodes. Their 'next[0]' still leads
+				// forward to a linked node, or off the end, where the tail is.
+				for (node* n = head; n; n = n->next[0]) {
+					node* target = n->next[1];
+					while (target != n && is_dead(target))
+						target = target->next[0] ? target->next[0] : tail;
+					if (target != n->next[1])
+						store(n->next[1], target);
+				}
+				if (head)
+					store(head->next[1], tail);
+
+				node_count -= unlinked.size();
+				needs_rebalance = true;
+
+				// Readers that open from now on can not reach the unlinked nodes
+				std::scoped_lock view_lock(view_mutex);
+				retired.push_back({ next_ticket, std::move(unlinked) });
+			}
+
+			free_retired();
+			try_rebalance();
+		}
+
+		// Rebalances the skip links if no views are open. Returns false if it could not.
+		bool rebalance() {
+			std::scoped_lock lock(write_mutex);
+			return try_rebalance();
+		}
+
+	private:
+		struct retired_batch {
+			std::uint64_t ticket; // readers with an earlier ticket may still be on the nodes
+			std::vector<node*> nodes;
+		};
+
+		static node* load(node* const& p) {
+			return std::atomic_ref<node*>(const_cast<node*&>(p)).load(std::memory_order_acquire);
+		}
+
+		static void store(node*& p, node* val) {
+			std::atomic_ref<node*>(p).store(val, std::memory_order_release);
+		}
+
+		static version_type load_end(node const* n) {
+			return std::atomic_ref<version_type>(const_cast<version_type&>(n->end)).load(std::memory_order_acquire);
+		}
+
+		// Returns the first node that is not less than 'val'. Safe to call concurrently with writers.
+		node* lower_bound_node(key_type const& val) const {
+			node* n = load(head);
+			if (n == nullptr || !(n->key() < val))
+				return n;
+
+			while (true) {
+				node* const next = load(n->next[0]);
+				if (next == nullptr || !(next->key() < val))
+					return next;
+
+				node* const skip = load(n->next[1]);
+				n = (skip->key() < val) ? skip : next;
+			}
+		}
+
+		void close_view(std::uint64_t ticket) const {
+			std::scoped_lock lock(view_mutex);
+			views.erase(ticket);
+		}
+
+		// Requires the write lock
+		void free_retired() {
+			std::uint64_t oldest_ticket;
+			{
+				std::scoped_lock lock(view_mutex);
+				oldest_ticket = views.empty() ? next_ticket : views.begin()->first;
+			}
+
+			std::erase_if(retired, [&](retired_batch& batch) {
+				if (batch.ticket > oldest_ticket)
+					return false;
+
+				for (node* n : batch.nodes) {
+					std::destroy_at(n);
+					alloc.deallocate({ n, 1 });
+				}
+				return true;
+			});
+		}
+
+		// Requires the write lock. Readers are kept out while the skip links are rewritten.
+		bool try_rebalance() {
+			if (!head || !needs_rebalance)
+				return true;
+
+			std::scoped_lock lock(view_mutex);
+			if (!views.empty())
+				return false;
+
+			balance_helper bh(head, node_count);
+			while (bh)
+				bh.balance_current_and_advance();
+			needs_rebalance = false;
+			return true;
+		}
+
+		node* head = nullptr;
+		std::size_t node_count = 0;
+		bool needs_rebalance = false;
+		std::atomic<version_type> current{ 0 };
+		std::atomic<std::size_t> live_count{ 0 };
+		std::vector<retired_batch> retired;
+		scatter_allocator<node> alloc;
+		std::mutex write_mutex;
+
+		// Open views, by ticket
+		mutable std::map<std::uint64_t, version_type> views;
+		mutable std::uint64_t next_ticket = 0;
+		mutable std::mutex view_mutex;
+	};
+}
+#endif
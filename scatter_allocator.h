@@ -5,6 +5,9 @@
 #include <span>
 #include <memory>
 #include <vector>
+#include <algorithm>
+#include <cstring>
+#include <cstdint>
 
 namespace kg {
 	template <typename Fn, typename T>
@@ -54,6 +57,78 @@ namespace kg {
 			return t;
 		}
 
+		// Allocates a single object, preferably no more than 'near_bytes' away from 'hint',
+		// so objects that are used together share pages and cache lines. The closest free
+		// slot is picked from the start of the free list and the unused part of the pool
+		// that holds 'hint'. If none are near enough, it is the same as 'allocate_one'.
+		constexpr T* allocate_near(T const* hint) {
+			if consteval {
+				// Addresses of unrelated objects can not be compared at compile time
+				return allocate_one();
+			}
+			else {
+				if (hint == nullptr)
+					return allocate_one();
+
+				auto const target = reinterpret_cast<std::uintptr_t>(hint);
+				auto const distance = [target](T const* p) {
+					auto const addr = reinterpret_cast<std::uintptr_t>(p);
+					return (addr < target) ? target - addr : addr - target;
+				};
+
+				// The slots at the ends of the free blocks. 'hint' is allocated, so it is not
+				// inside a free block, and the end facing it is the closest slot in the block.
+				std::unique_ptr<free_block>* best_block = nullptr;
+				T* best_slot = nullptr;
+				std::uintptr_t best_distance = near_bytes + 1;
+				std::unique_ptr<free_block>* ptr_free = &free_list;
+				for (std::size_t i = 0; *ptr_free && i < max_free_blocks_searched; ptr_free = &(*ptr_free)->next, i++) {
+					std::span<T> const span = (*ptr_free)->span;
+					if (span.empty())
+						continue;
+
+					T* const slot = (reinterpret_cast<std::uintptr_t>(span.data()) > target) ? span.data() : &span.back();
+					if (distance(slot) < best_distance) {
+						best_block = ptr_free;
+						best_slot = slot;
+						best_distance = distance(slot);
+					}
+				}
+
+				// The next unused slot in the pool that holds 'hint'
+				pool* best_pool = nullptr;
+				for (pool* p = pools.get(); p; p = p->next.get()) {
+					if (valid_addr(const_cast<T*>(hint), &p->data.front(), &p->data.back())) {
+						if (p->next_available < p->data.size() && distance(&p->data[p->next_available]) < best_distance) {
+							best_pool = p;
+							best_slot = &p->data[p->next_available];
+						}
+						break;
+					}
+				}
+
+				if (best_pool) {
+					best_pool->next_available += 1;
+				}
+				else if (best_block) {
+					free_block* const block = best_block->get();
+					if (best_slot == block->span.data())
+						block->span = block->span.subspan(1);
+					else
+						block->span = block->span.first(block->span.size() - 1);
+
+					if (block->span.empty()) {
+						auto next = std::move(block->next);
+						*best_block = std::move(next);
+					}
+				}
+				else {
+					best_slot = allocate_one();
+				}
+				return best_slot;
+			}
+		}
+
 		constexpr void allocate_with_callback(std::size_t const count, callback_takes_a_span<T> auto&& alloc_callback) {
 			std::size_t remaining_count = count;
 
@@ -70,18 +145,20 @@ namespace kg {
 				std::span<T> span = ptr->span.subspan(0, min_space);
 				alloc_callback(span);
 
-				remaining_count -= min_space;
-				if (remaining_count == 0)
-					return;
-
+				// Shrink or unlink the block before returning, so the same
+				// memory is not handed out twice
 				if (min_space == ptr->span.size()) {
 					auto next = std::move(ptr->next);
 					*ptr_free = std::move(next);
 				}
 				else {
-					ptr->span = ptr->span.subspan(min_space + 1);
+					ptr->span = ptr->span.subspan(min_space);
 					ptr_free = &ptr->next;
 				}
+
+				remaining_count -= min_space;
+				if (remaining_count == 0)
+					return;
 			}
 
 			// Take space from pools
@@ -110,34 +187,44 @@ namespace kg {
 		constexpr void deallocate(std::span<T> const span) {
 			assert(validate_addr(span) && "Invalid address passed to deallocate()");
 
-			// Poison the allocation
+			// Poison the allocation. It holds no objects any more, so it is written as raw memory.
 			if (!std::is_constant_evaluated())
-				std::memset(span.data(), 0xee, span.size_bytes());
+				std::memset(static_cast<void*>(span.data()), 0xee, span.size_bytes());
 
 			// Add it to the free list
 			free_list = std::make_unique<free_block>(std::move(free_list), span);
 		}
 
 	private:
+		// How far from the hint 'allocate_near' may place an object, and how much
+		// of the free list it looks through
+		static constexpr std::uintptr_t near_bytes = 4096;
+		static constexpr std::size_t max_free_blocks_searched = 32;
+
 		constexpr auto* add_pool(std::size_t const size) {
 			std::span data{ std::allocator<T>{}.allocate(size), size };
 			pools = std::make_unique<pool>(0, data, std::move(pools));
 			return pools.get();
 		}
 
-		static constexpr bool valid_addr(T* p, T* begin, T* end) {
+		// Is 'p' in [first, last]
+		static constexpr bool valid_addr(T* p, T* first, T* last) {
 			// It is undefined behavior to compare pointers directly,
 			// so use distances instead. This also works at compile time.
-			auto const size = std::distance(begin, end);
-			return std::distance(begin, p) >= 0 && std::distance(p, end) <= size;
+			return std::distance(first, p) >= 0 && std::distance(p, last) >= 0;
 		}
 
 		constexpr bool validate_addr(std::span<T> const span) {
+			// Pointers into different pools can not be compared at compile time,
+			// and the compiler will catch bad frees there anyway.
+			if (std::is_constant_evaluated())
+				return true;
+
 			for (auto* p = pools.get(); p; p = p->next.get()) {
-				if (!valid_addr(span.data(), &p->data.front(), &p->data.back()))
-					return false;
+				if (valid_addr(span.data(), &p->data.front(), &p->data.back()))
+					return true;
 			}
-			return true;
+			return false;
 		}
 
 		struct pool {
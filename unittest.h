@@ -9,3 +9,14 @@
 #define xassert(e, sz) assert((e) && (sz))
 #define UNITTEST xassert
 #endif
+
+// For things that can only be tested at run time, like threads and atomics
+#include <cstdio>
+#include <cstdlib>
+inline void runtime_unittest(bool passed, char const* sz) {
+	if (!passed) {
+		std::fprintf(stderr, "unittest failed: %s\n", sz);
+		std::exit(1);
+	}
+}
+#define RUNTIME_UNITTEST(...) runtime_unittest(__VA_ARGS__)